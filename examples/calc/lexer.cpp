@@ -18,17 +18,34 @@ namespace calc
 //                                Tokens
 
 
+namespace
+{
+
+// The fixed tokens of the language.
+constexpr Token_spec token_spec_[] = {
+  {lparen_tok,  "lparen_tok",  "("},
+  {rparen_tok,  "rparen_tok",  ")"},
+  {plus_tok,    "plus_tok",    "+"},
+  {minus_tok,   "minus_tok",   "-"},
+  {star_tok,    "star_tok",    "*"},
+  {slash_tok,   "slash_tok",   "/"},
+  {percent_tok, "percent_tok", "%"},
+};
+
+
+// The recognizer for fixed tokens is built at compile time.
+constexpr auto token_table_ = make_token_table(token_spec_);
+
+auto tokens_ = make_token_set(token_table_);
+
+} // namespace
+
+
 // Initialize the token set used by the language.
 void
 init_tokens()
 {
-  install_token(lparen_tok,  "lparen_tok", "(");
-  install_token(rparen_tok,  "rparen_tok", ")");
-  install_token(plus_tok,    "plus_tok",   "+");
-  install_token(minus_tok,   "minus_tok",  "-");
-  install_token(star_tok,    "star_tok",   "*");
-  install_token(slash_tok,   "slash_tok",   "/");
-  install_token(percent_tok, "percent_tok", "%");
+  tokens_.install();
 }
 
 
@@ -86,50 +103,49 @@ token(Lexer& lex, Character_stream& cs)
 Token
 Lexer::on_lparen(Location loc, char const* str)
 {
-  return Token(loc, str, 1);
+  return Token(loc, lparen_tok);
 }
 
 
 Token
 Lexer::on_rparen(Location loc, char const* str)
 {
-  return Token(loc, str, 1);
+  return Token(loc, rparen_tok);
 }
 
 
 Token
 Lexer::on_plus(Location loc, char const* str)
 {
-  Token tok = Token(loc, str, 1);
-  return tok;
+  return Token(loc, plus_tok);
 }
 
 
 Token
 Lexer::on_minus(Location loc, char const* str)
 {
-  return Token(loc, str, 1);
+  return Token(loc, minus_tok);
 }
 
 
 Token
 Lexer::on_star(Location loc, char const* str)
 {
-  return Token(loc, str, 1);
+  return Token(loc, star_tok);
 }
 
 
 Token
 Lexer::on_slash(Location loc, char const* str)
 {
-  return Token(loc, str, 1);
+  return Token(loc, slash_tok);
 }
 
 
 Token
 Lexer::on_percent(Location loc, char const* str)
 {
-  return Token(loc, str, 1);
+  return Token(loc, percent_tok);
 }
 
 
@@ -161,7 +177,7 @@ lex(Character_stream& cs)
 Integer
 as_integer(Token const& tok)
 {
-  return Integer(*tok.str(), 10);
+  return Integer(tok.str().str(), 10);
 }
 
 
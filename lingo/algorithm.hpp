@@ -33,6 +33,12 @@ template<typename T>
 using Value_type = typename T::value_type;
 
 
+// The location type of a stream. This is the type returned
+// by `s.location()`.
+template<typename T>
+using Location_type = decltype(std::declval<T const&>().location());
+
+
 // The argument type of a transform (lexer or parser).
 template<typename T>
 using Argument_type = typename T::argument_type;
@@ -77,6 +83,66 @@ template<typename T>
 using Range_over = Range<Iterator_type<T>>;
 
 
+// -------------------------------------------------------------------------- //
+//                              Sentinels
+//
+// A stream has a sentinel if it defines a static data member named
+// `sentinel`, which is the value of peek() at the end of the stream
+// (see Unchecked_character_stream). The algorithms below only check
+// for the end of such a stream when the current element satisfies
+// a predicate and is equal to the sentinel. Predicates that reject
+// the sentinel are never checked against the end of the stream.
+//
+// Predicates on streams, as used by discard_if and match_range, are
+// expected to test elements with next_element_if or similar, which
+// detect the end of the stream. For streams with a sentinel, those
+// algorithms do not check for the end themselves.
+
+
+// True if the stream type T has a sentinel.
+template<typename T, typename = void>
+struct Has_sentinel : std::false_type { };
+
+
+template<typename T>
+struct Has_sentinel<T, decltype(void(T::sentinel))> : std::true_type { };
+
+
+// Returns true if the next element satisfies `pred`.
+template<typename Stream, typename Pred>
+inline bool
+check_next_element(Stream const& s, Pred pred, std::false_type)
+{
+  return !s.eof() && pred(s.peek());
+}
+
+
+template<typename Stream, typename Pred>
+inline bool
+check_next_element(Stream const& s, Pred pred, std::true_type)
+{
+  auto const& c = s.peek();
+  return pred(c) && (c != Stream::sentinel || !s.eof());
+}
+
+
+// Returns true if the stream satisfies the stream predicate `pred`.
+template<typename Stream, typename Pred>
+inline bool
+check_stream(Stream& s, Pred pred, std::false_type)
+{
+  return !s.eof() && pred(s);
+}
+
+
+template<typename Stream, typename Pred>
+inline bool
+check_stream(Stream& s, Pred pred, std::true_type)
+{
+  return pred(s);
+}
+
+
 // -------------------------------------------------------------------------- //
 //                              Next element
 
@@ -86,7 +152,8 @@ template<typename Stream, typename T>
 inline bool 
 next_element_is(Stream const& s, T const& x)
 {
-  return !s.eof() && s.peek() == x;
+  auto pred = [&x](Value_type<Stream> const& c) { return c == x; };
+  return check_next_element(s, pred, Has_sentinel<Stream>());
 }
 
 
@@ -96,7 +163,8 @@ template<typename Stream, typename T>
 inline bool 
 next_element_is_not(Stream const& s, T const& x)
 {
-  return !s.eof() && s.peek() != x;
+  auto pred = [&x](Value_type<Stream> const& c) { return c != x; };
+  return check_next_element(s, pred, Has_sentinel<Stream>());
 }
 
 
@@ -122,7 +190,7 @@ template<typename Stream, typename Pred>
 inline bool 
 next_element_if(Stream const& s, Pred pred)
 {
-  return !s.eof() && pred(s.peek());
+  return check_next_element(s, pred, Has_sentinel<Stream>());
 }
 
 
@@ -213,7 +281,7 @@ template<typename Stream, typename T>
 inline Iterator_type<Stream>
 match(Stream& s, T const& t)
 {
-  if (!s.eof() && s.peek() == t)
+  if (next_element_is(s, t))
     return &s.get();
   else
     return {};
@@ -228,7 +296,7 @@ template<typename Stream, typename P>
 inline Iterator_type<Stream>
 match_if(Stream& s, P pred)
 {
-  if (!s.eof() && pred(s.peek()))
+  if (next_element_if(s, pred))
     return &s.get();
   else
     return {};
@@ -328,7 +396,7 @@ match_range_after_first(Stream& s, P pred)
 {
   assert(pred(s));
   Iterator_type<Stream> first = &s.get(); // Save the first position
-  while (!s.eof() && pred(s)) {
+  while (check_stream(s, pred, Has_sentinel<Stream>())) {
     s.get();
   }
   Iterator_type<Stream> last = s.begin(); // Past the end of the range
@@ -382,7 +450,7 @@ inline Iterator_type<Stream>
 discard_if(Stream& s, P pred)
 {
   auto iter = s.begin();
-  while (!s.eof() && pred(s))
+  while (check_stream(s, pred, Has_sentinel<Stream>()))
     s.get();
   return iter;
 }
@@ -2,41 +2,248 @@
 // All rights reserved
 
 #include "buffer.hpp"
+#include "thread.hpp"
 #include "error.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 
 namespace lingo
 {
 
-// Start a new line, having the give offset and starting pointer.
-Line&
-Line_map::start_line(int off, char const* ptr)
+namespace
+{
+
+// Append the offset of each line that starts in the range
+// [first, last) to `lines`. A line starts just past each
+// newline character. Offsets are relative to `base`.
+//
+// The scan compares 32 (AVX2) or 16 (SSE2) characters at a
+// time, and the remaining characters one at a time. Each set
+// bit in the comparison mask is the position of a newline.
+void
+scan_lines(char const* base, char const* first, char const* last, std::vector<int>& lines)
+{
+  char const* iter = first;
+#if defined(__AVX2__)
+  __m256i const nl32 = _mm256_set1_epi8('\n');
+  for (; last - iter >= 32; iter += 32) {
+    __m256i chars = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(iter));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, nl32));
+    for (; mask; mask &= mask - 1)
+      lines.push_back(iter - base + __builtin_ctz(mask) + 1);
+  }
+#endif
+#if defined(__SSE2__)
+  __m128i const nl16 = _mm_set1_epi8('\n');
+  for (; last - iter >= 16; iter += 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<__m128i const*>(iter));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, nl16));
+    for (; mask; mask &= mask - 1)
+      lines.push_back(iter - base + __builtin_ctz(mask) + 1);
+  }
+#endif
+  for (; iter != last; ++iter) {
+    if (*iter == '\n')
+      lines.push_back(iter - base + 1);
+  }
+}
+
+// Returns true if the characters in [first, last) are all ASCII.
+// This checks the high bit of 16 characters at a time.
+bool
+is_ascii(char const* first, char const* last)
+{
+  char const* iter = first;
+#if defined(__SSE2__)
+  for (; last - iter >= 16; iter += 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<__m128i const*>(iter));
+    if (_mm_movemask_epi8(chars))
+      return false;
+  }
+#endif
+  for (; iter != last; ++iter) {
+    if (*iter & 0x80)
+      return false;
+  }
+  return true;
+}
+
+
+// Parallel indexing is used for texts with at least this many
+// characters. It is disabled when the threshold is 0.
+std::size_t par_threshold_ = 0;
+
+// The number of chunks scanned in parallel.
+int par_threads_ = 1;
+
+
+// Scan [first, last) for lines in parallel, appending their offsets
+// to `lines`. Each chunk is scanned into its own table, and the
+// tables are concatenated in order. The calling thread scans the
+// first chunk.
+void
+scan_lines_parallel(char const* first, char const* last, std::vector<int>& lines)
+{
+  int n = par_threads_;
+  std::size_t size = (last - first + n - 1) / n;
+  std::vector<std::vector<int>> chunks(n);
+  std::vector<std::future<void>> tasks;
+  for (int i = 1; i < n; ++i) {
+    char const* f = first + std::min<std::size_t>(i * size, last - first);
+    char const* l = first + std::min<std::size_t>((i + 1) * size, last - first);
+    std::vector<int>& out = chunks[i];
+    tasks.push_back(thread_pool().submit([=, &out]() { 
+      scan_lines(first, f, l, out); 
+    }));
+  }
+  scan_lines(first, first, first + std::min<std::size_t>(size, last - first), chunks[0]);
+  for (std::future<void>& t : tasks)
+    t.get();
+
+  // Compute the position of each chunk in the final table, and
+  // copy the chunks into place.
+  std::size_t pos = lines.size();
+  std::size_t total = pos;
+  for (std::vector<int> const& c : chunks)
+    total += c.size();
+  lines.resize(total);
+  for (std::vector<int> const& c : chunks) {
+    std::copy(c.begin(), c.end(), lines.begin() + pos);
+    pos += c.size();
+  }
+}
+
+} // namespace
+
+
+// Use `n` threads to build line maps for buffers with at least
+// `threshold` characters.
+void
+set_parallel_indexing(std::size_t threshold, int n)
+{
+  lingo_assert(n > 0);
+  par_threshold_ = threshold;
+  par_threads_ = n;
+}
+
+
+// Build all line maps sequentially.
+void
+disable_parallel_indexing()
+{
+  par_threshold_ = 0;
+  par_threads_ = 1;
+}
+
+
+// Returns the number of UTF-8 continuation bytes (those of the form
+// 10xxxxxx) in [first, last). As signed values, these are exactly the
+// bytes less than -64. Continuation bytes are counted 16 at a time.
+int
+count_continuations(char const* first, char const* last)
+{
+  int n = 0;
+  char const* iter = first;
+#if defined(__SSE2__)
+  __m128i const bound = _mm_set1_epi8(-64);
+  for (; last - iter >= 16; iter += 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<__m128i const*>(iter));
+    n += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(chars, bound)));
+  }
+#endif
+  for (; iter != last; ++iter) {
+    if (static_cast<signed char>(*iter) < -64)
+      ++n;
+  }
+  return n;
+}
+
+
+// Build the line map for the text in [first, last). There is
+// always at least one line, starting at offset 0. Line maps built
+// by pool workers (e.g., for prefetched files) are built sequentially.
+Line_map::Line_map(char const* first, char const* last)
 {
-  auto ins = insert({off, Line(size() + 1, off, ptr, nullptr)});
-  return ins.first->second;
+  std::size_t n = last - first;
+  lines_.reserve(n / 64 + 1);
+  lines_.push_back(0);
+  if (par_threshold_ && n >= par_threshold_ && par_threads_ > 1 && !is_worker_thread())
+    scan_lines_parallel(first, last, lines_);
+  else
+    scan_lines(first, first, last, lines_);
 }
 
 
-// Terminate the line so that it ends with the given character.
+// Start a new line at the given offset. Lines must be started
+// in increasing order of offset.
 void
-Line_map::finish_line(Line& line, char const* ptr)
+Line_map::start_line(int off)
 {
-  line.last = ptr;
+  lingo_assert(empty() || lines_.back() < off);
+  lines_.push_back(off);
 }
 
 
-// Returns the line number for the character offset. 
-Line const&
-Line_map::line(Location loc) const
+namespace
+{
+
+// The last line found by this thread, and the line map it was
+// found in. The hint is per thread so that lookups in a shared
+// line map do not race.
+thread_local Line_map const* hint_map_ = nullptr;
+thread_local int             hint_line_ = 0;
+
+} // namespace
+
+
+// Returns the index of the line containing the given location.
+//
+// If the location is in the last line found by this thread in this
+// map, or the one after it, that line is returned. Otherwise, this
+// is a binary search for the last line whose starting offset is
+// less than or equal to that of the location. The loop body
+// compiles to a conditional move, so the search does not branch
+// on the comparison.
+int
+Line_map::line_index(Location loc) const
 {
   lingo_assert(!empty());
 
-  // Find the line whose starting offset is greater than that
-  // of the location. The location's line number is the
-  // previous location.
-  auto iter = --upper_bound(loc.offset());
-  return iter->second;
+  int const  off = loc.offset();
+  int const* first = lines_.data();
+  int        n = lines_.size();
+
+  // A map may be allocated where a larger one was destroyed, so
+  // the hint is also checked against the size.
+  int i = hint_map_ == this ? hint_line_ : 0;
+  if (i < n && first[i] <= off) {
+    if (i + 1 == n || off < first[i + 1])
+      return i;
+    if (i + 2 == n || off < first[i + 2])
+      return hint_line_ = i + 1;
+  }
+
+  int const* base = first;
+  while (n > 1) {
+    int half = n / 2;
+    base = (base[half] <= off) ? base + half : base;
+    n -= half;
+  }
+  hint_map_ = this;
+  return hint_line_ = base - first;
 }
 
 
@@ -44,44 +251,224 @@ Line_map::line(Location loc) const
 int 
 Line_map::line_no(Location loc) const
 {
-  return line(loc).number();
+  return line_index(loc) + 1;
 }
 
 
-// Returns the column number for the given location.
+// Returns the byte column number for the given location.
 int
 Line_map::column_no(Location loc) const
 {
-  return loc.offset() - line(loc).offset() + 1;
+  return loc.offset() - line_offset(line_index(loc)) + 1;
+}
+
+
+// -------------------------------------------------------------------------- //
+//                            Mapped regions
+
+namespace
+{
+
+// Returns the number of bytes mapped for a file of `n` bytes,
+// including the null character and padding.
+inline std::size_t
+mapped_length(std::size_t n)
+{
+  static std::size_t page = ::sysconf(_SC_PAGESIZE);
+  return (n + buffer_padding + 1 + page - 1) / page * page;
+}
+
+} // namespace
+
+
+// Map the contents of the file at `path` into memory. If the
+// file cannot be opened or mapped, the region is empty.
+Mapped_region::Mapped_region(char const* path)
+  : data_(nullptr), size_(0)
+{
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return;
+
+  // Only map non-empty regular files. Mapping an empty
+  // file is an error.
+  //
+  // The file is mapped over the start of a zero-filled anonymous
+  // mapping that is large enough to hold the padding. The rest of
+  // the file's last page is also zero-filled.
+  struct stat st;
+  if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    std::size_t len = mapped_length(st.st_size);
+    void* p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) {
+      if (::mmap(p, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+        ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+        data_ = static_cast<char const*>(p);
+        size_ = st.st_size;
+      } else {
+        ::munmap(p, len);
+      }
+    }
+  }
+
+  // The mapping remains valid after the file is closed.
+  ::close(fd);
+}
+
+
+Mapped_region::Mapped_region(Mapped_region&& x)
+  : data_(x.data_), size_(x.size_)
+{
+  x.data_ = nullptr;
+  x.size_ = 0;
+}
+
+
+Mapped_region& 
+Mapped_region::operator=(Mapped_region&& x)
+{
+  std::swap(data_, x.data_);
+  std::swap(size_, x.size_);
+  return *this;
+}
+
+
+Mapped_region::~Mapped_region()
+{
+  if (data_)
+    ::munmap(const_cast<char*>(data_), mapped_length(size_));
 }
 
 
-// Initialize the buffer with the given text. Perform a cursory
-// analysis of the input in order to construct the line map
-// for the input source.
+// -------------------------------------------------------------------------- //
+//                                Buffers
+
+// Initialize the buffer with a copy of the given text.
 Buffer::Buffer(String const& str)
-  : text_(str)
-{
-  char const *first = &text_.front();
-  char const *last = first + text_.size();
-  char const *iter = first;
-  int pos = 0;
-  while (iter != last) {
-    if (*iter == '\n') {
-      insert({pos, Line(size() + 1, pos, first + pos, iter)});
-      pos = iter - first + 1; // Starts past the newline.
+{
+  text_.reserve(str.size() + buffer_padding);
+  text_ = str;
+  text_.append(buffer_padding, 0);
+}
+
+
+// Initialize the buffer by taking ownership of the given text.
+// The text is not copied unless it must grow to hold the padding.
+Buffer::Buffer(String&& str)
+  : text_(std::move(str))
+{
+  text_.append(buffer_padding, 0);
+}
+
+
+// Initialize the buffer with the text in the mapped region. The
+// buffer takes ownership of the region.
+Buffer::Buffer(Mapped_region&& map)
+  : map_(std::move(map))
+{ }
+
+
+// Returns the line of text containing the given location. The
+// line ends at its newline character or at the end of the
+// buffer.
+Line
+Buffer::line(Location loc) const
+{
+  Line_map const& lines = this->lines();
+  int n = lines.line_index(loc);
+  int first = lines.line_offset(n);
+  int last = n + 1 < lines.size() ? lines.line_offset(n + 1) - 1 : size();
+  return Line(n + 1, first, begin() + first, begin() + last);
+}
+
+
+// Returns the column number of the given location.
+int
+Buffer::column_no(Location loc) const
+{
+  Line_map const& lines = this->lines();
+  return column_in_line(lines.line_index(loc), loc.offset());
+}
+
+
+// Resolve the line and column numbers of each location in [first,
+// last), storing them in the corresponding element of `out`. The
+// locations are sorted so that the line map is traversed once.
+// Invalid locations resolve to line and column 0.
+void
+Buffer::resolve_all(Location const* first, Location const* last, Position* out) const
+{
+  std::vector<int> order(last - first);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [first](int a, int b) {
+    return first[a].offset() < first[b].offset();
+  });
+
+  Line_map const& lines = this->lines();
+  int n = 0;
+  for (int i : order) {
+    int off = first[i].offset();
+    if (off < 0) {
+      out[i] = {0, 0};
+      continue;
     }
-    ++iter;
+    while (n + 1 < lines.size() && lines.line_offset(n + 1) <= off)
+      ++n;
+    out[i] = {n + 1, column_in_line(n, off)};
+  }
+}
+
+
+// Returns the line and column numbers of each location.
+std::vector<Position>
+Buffer::resolve_all(std::vector<Location> const& locs) const
+{
+  std::vector<Position> pos(locs.size());
+  resolve_all(locs.data(), locs.data() + locs.size(), pos.data());
+  return pos;
+}
+
+
+// Returns the column number of the offset `off` in the nth line.
+// Continuation bytes preceding the offset in the line are not 
+// counted, unless the line is known to be ASCII. The offset must be
+// in the buffer, since the characters before it are read.
+int
+Buffer::column_in_line(int n, int off) const
+{
+  lingo_assert(0 <= off && off <= (int)size());
+  int first = lines_.line_offset(n);
+  int col = off - first + 1;
+  if (!is_ascii_line(n))
+    col -= count_continuations(begin() + first, begin() + off);
+  return col;
+}
+
+
+// Returns true if the nth line of the buffer contains only ASCII
+// characters, caching the result.
+bool
+Buffer::is_ascii_line(int n) const
+{
+  if ((int)enc_.size() <= n)
+    enc_.resize(lines_.size(), unknown_line);
+  if (enc_[n] == unknown_line) {
+    Line l = line(Location(lines_.line_offset(n)));
+    enc_[n] = is_ascii(l.begin(), l.end()) ? ascii_line : utf8_line;
   }
-  insert({pos, Line(size() + 1, pos, first + pos, iter)});
+  return enc_[n] == ascii_line;
 }
 
 
 namespace
 {
 
-Buffer*  buf_ = nullptr;
-Location loc_;
+Buffer*               buf_ = nullptr;
+Location              loc_;
+Input_tracker*        tracker_ = nullptr; // The last registered tracker
+Input_tracker*        reader_ = nullptr;  // The active tracker
+bool                  tracking_ = false;  // True if trackers are used
+Source_manager const* sm_ = nullptr;
 
 
 } // namespace
@@ -96,14 +483,32 @@ input_buffer()
 }
 
 
-/* Returns the current input location. */
+// Returns the current input location. If input trackers are in
+// use, the location is obtained from the active tracker or, if
+// there is none, the most recently registered one. Suspended
+// trackers are skipped in favor of those registered before them.
 Location
 input_location()
 {
+  if (tracking_) {
+    for (Input_tracker* t = reader_ ? reader_ : tracker_; t; t = t->below_) {
+      if (!t->suspended_)
+        return t->location();
+    }
+  }
   return loc_;
 }
 
 
+// Returns the source manager used to resolve input locations, or
+// null if they are offsets in the input buffer.
+Source_manager const*
+input_source_manager()
+{
+  return sm_;
+}
+
+
 // Set the current input buffer. The previous buffer
 // is not saved. See the Input_guard class.
 void
@@ -113,19 +518,26 @@ set_input_buffer(Buffer& buf)
 }
 
 
-// Set the current input location.
+// Set the current input location. This overrides any
+// registered input tracker until a stream reads again.
 void
 set_input_location(Location loc)
 {
   loc_ = loc;
+  tracking_ = false;
+  if (reader_) {
+    reader_->active_ = false;
+    reader_ = nullptr;
+  }
 }
 
 
 // Update the current source location.
 Input_context::Input_context(Location loc)
-  : saved_buf(buf_), saved_loc(loc_)
+  : saved_buf(buf_), saved_loc(loc_), saved_tracking(tracking_), saved_sm(sm_)
 { 
   loc_ = loc;
+  tracking_ = false;
 }
 
 
@@ -134,20 +546,37 @@ Input_context::Input_context(Location loc)
 //
 // TODO: Set the source location to something meaningful?
 Input_context::Input_context(Buffer& buf)
-  : saved_buf(buf_), saved_loc(loc_)
+  : saved_buf(buf_), saved_loc(loc_), saved_tracking(tracking_), saved_sm(sm_)
 {
   buf_ = &buf;
   loc_ = Location::none;
+  tracking_ = false;
+  sm_ = nullptr;
 }
 
 
 // Update the current input context to the given buffer
 // and source location.
 Input_context::Input_context(Buffer& buf, Location loc)
-  : saved_buf(buf_), saved_loc(loc_)
+  : saved_buf(buf_), saved_loc(loc_), saved_tracking(tracking_), saved_sm(sm_)
 {
   buf_ = &buf;
   loc_ = loc;
+  tracking_ = false;
+  sm_ = nullptr;
+}
+
+
+// Update the current input buffer, which has been added to the
+// source manager. Input locations are source locations, and are
+// resolved by the source manager.
+Input_context::Input_context(Buffer& buf, Source_manager const& sm)
+  : saved_buf(buf_), saved_loc(loc_), saved_tracking(tracking_), saved_sm(sm_)
+{
+  buf_ = &buf;
+  loc_ = Location::none;
+  tracking_ = false;
+  sm_ = &sm;
 }
 
 
@@ -156,7 +585,115 @@ Input_context::~Input_context()
 {
   buf_ = saved_buf;
   loc_ = saved_loc;
+  tracking_ = saved_tracking;
+  sm_ = saved_sm;
+}
+
+
+// -------------------------------------------------------------------------- //
+//                              Input trackers
+
+// Register the tracker. The input location is `fn(obj)`.
+Input_tracker::Input_tracker(Input_location_fn fn, void const* obj)
+  : fn_(fn), obj_(obj), active_(false), suspended_(false)
+{
+  link();
+}
+
+
+// Register a copy of the tracker `t` for the object `obj`. The
+// copy is not active until its stream reads.
+Input_tracker::Input_tracker(Input_tracker const& t, void const* obj)
+  : Input_tracker(t.fn_, obj)
+{ }
+
+
+// Register the object `obj` in place of the tracker `t`, which
+// is no longer registered.
+Input_tracker::Input_tracker(Input_tracker&& t, void const* obj)
+  : fn_(t.fn_), obj_(t.obj_ ? obj : nullptr), below_(t.below_), above_(t.above_), 
+    active_(t.active_), suspended_(t.suspended_)
+{
+  if (!obj_)
+    return;
+  if (below_)
+    below_->above_ = this;
+  if (above_)
+    above_->below_ = this;
+  else
+    tracker_ = this;
+  if (active_)
+    reader_ = this;
+  t.obj_ = nullptr;
+  t.active_ = false;
+}
+
+
+// Unregister the tracker.
+Input_tracker::~Input_tracker()
+{
+  unlink();
+}
+
+
+// Make this the active tracker.
+void
+Input_tracker::make_active()
+{
+  if (reader_)
+    reader_->active_ = false;
+  reader_ = this;
+  active_ = true;
+  tracking_ = true;
+}
+
+
+// Register the tracker as the most recent one.
+void
+Input_tracker::link()
+{
+  below_ = tracker_;
+  above_ = nullptr;
+  if (below_)
+    below_->above_ = this;
+  tracker_ = this;
+}
+
+
+// Remove the tracker from the registered trackers, wherever
+// it is among them.
+void
+Input_tracker::unlink()
+{
+  if (!obj_)
+    return;
+  if (below_)
+    below_->above_ = above_;
+  if (above_)
+    above_->below_ = below_;
+  else
+    tracker_ = below_;
+  if (active_)
+    reader_ = nullptr;
+  obj_ = nullptr;
 }
 
 
-} // namespace
\ No newline at end of file
+// Suspend the tracker `t`.
+Tracker_suspension::Tracker_suspension(Input_tracker& t)
+  : tracker_(t), active_(t.active_)
+{
+  tracker_.suspended_ = true;
+}
+
+
+// Resume the tracker, making it active again if it was active
+// before and trackers are still in use.
+Tracker_suspension::~Tracker_suspension()
+{
+  tracker_.suspended_ = false;
+  if (active_ && tracking_)
+    tracker_.activate();
+}
+
+} // namespace
@@ -7,7 +7,8 @@
 #include "lingo/string.hpp"
 #include "lingo/location.hpp"
 
-#include <map>
+#include <vector>
+#include <utility>
 
 namespace lingo
 {
@@ -42,22 +43,116 @@ public:
 };
 
 
+// The line and column numbers of a location.
+struct Position
+{
+  int line;
+  int column;
+};
+
+
 // A line map associates an offset in the source code with
 // it's underlying line of text.
-struct Line_map : std::map<int, Line>
+//
+// The map is a sorted array containing the offset of the first
+// character of each line. Line objects are not stored; they are
+// created on demand by the buffer that owns the text.
+//
+// The map remembers the last line found. Repeated lookups in the
+// same line, and lookups in the following line, do not search.
+class Line_map
 {
+public:
+  Line_map() = default;
+  Line_map(char const*, char const*);
+
   // Observers
-  Line const& line(Location) const;
-  int         line_no(Location) const;
-  int         column_no(Location) const;
+  bool empty() const { return lines_.empty(); }
+  int  size() const  { return lines_.size(); }
+
+  int line_index(Location) const;
+  int line_no(Location) const;
+  int column_no(Location) const;
+
+  // Returns the offset of the first character in the nth line,
+  // counting from 0.
+  int line_offset(int n) const { return lines_[n]; }
 
   // Mutators. These are uesd to update the the line
   // map during lexical analysis.
-  Line& start_line(int, char const*);
-  void  finish_line(Line&, char const*);
+  void start_line(int);
+
+private:
+  std::vector<int> lines_;
 };
 
 
+// Returns the number of UTF-8 continuation bytes in [first, last).
+// Subtracting this from the number of bytes gives the number of
+// characters.
+int count_continuations(char const*, char const*);
+
+
+
+// -------------------------------------------------------------------------- //
+//                            Parallel indexing
+//
+// Line maps for very large buffers can be built in parallel. The
+// text is divided into one chunk per thread, each chunk is scanned
+// for newlines on the global thread pool, and the results are joined
+// into a single table. The resulting line map is the same as one
+// built sequentially.
+//
+// Parallel indexing is disabled by default. 
+
+void set_parallel_indexing(std::size_t, int);
+void disable_parallel_indexing();
+
+
+// -------------------------------------------------------------------------- //
+//                            Mapped regions
+
+// The number of zero bytes that follow the text of a buffer or
+// mapped region, not counting the terminating null character.
+// Lexers can stop at the null character instead of checking for
+// the end of input, and vectorized scanners can read past the end.
+constexpr std::size_t buffer_padding = 64;
+
+
+// A mapped region is a read-only view of a file's contents
+// mapped into memory. The region is unmapped when the object
+// is destroyed.
+//
+// The contents are followed by a null character and at least
+// buffer_padding zero bytes, which are also mapped.
+//
+// If the file cannot be mapped (e.g., it is empty or is not a
+// regular file), the region is empty and contextually converts
+// to false.
+class Mapped_region
+{
+public:
+  Mapped_region()
+    : data_(nullptr), size_(0)
+  { }
+
+  explicit Mapped_region(char const*);
+
+  Mapped_region(Mapped_region&&);
+  Mapped_region& operator=(Mapped_region&&);
+
+  ~Mapped_region();
+
+  explicit operator bool() const { return data_; }
+
+  char const* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  char const* data_;
+  std::size_t size_;
+};
+
 
 // -------------------------------------------------------------------------- //
 //                                Buffers
@@ -71,23 +166,52 @@ struct Line_map : std::map<int, Line>
 // memory buffers. In particular, a file is kind of buffer
 // that is read from disk.
 //
-// TODO: Provide better integration with I/O streams, etc. to
-// avoid unnecessary copies.
-class Buffer : private Line_map
+// The text of a buffer is either a string owned by the buffer
+// or a mapped region. A buffer can be constructed by moving
+// a string into it, in which case its text is not copied unless
+// the string has no room for padding.
+//
+// The text is always followed by a null character and at least
+// buffer_padding zero bytes, so end()[n] is 0 for all n in the
+// range [0, buffer_padding] (see Unchecked_character_stream).
+//
+// Column numbers count UTF-8 encoded characters, not bytes. Each
+// line is checked for non-ASCII characters the first time a column
+// in it is requested; columns in ASCII lines are computed directly
+// from offsets. Note that Line_map::column_no returns the byte
+// column.
+//
+// The line map is not built until the first time a location
+// in the buffer is resolved to a line or column. Inputs that
+// never issue diagnostics never scan for lines. Note that this
+// means that resolving locations is not thread safe.
+//
+// Derived classes may release their text when it is not in use
+// (see File_manager). The acquire() hook is called before a location
+// is resolved so that the text can be restored.
+//
+// Buffers can be moved but not copied.
+class Buffer
 {
 public:
   Buffer(String const& str);
+  Buffer(String&& str);
+  Buffer(Mapped_region&& map);
+
+  Buffer(Buffer&&) = default;
+  Buffer& operator=(Buffer&&) = default;
 
   virtual ~Buffer() { }
 
   // Lines
-  using Line_map::start_line;
-  using Line_map::finish_line;
-  using Line_map::line;
-  using Line_map::line_no;
-  using Line_map::column_no;
+  Line line(Location) const;
+  int  line_no(Location loc) const { return lines().line_no(loc); }
+  int  column_no(Location) const;
+
+  void                  resolve_all(Location const*, Location const*, Position*) const;
+  std::vector<Position> resolve_all(std::vector<Location> const&) const;
 
-  Line_map const& lines() const { return *this; }
+  Line_map const& lines() const;
 
   // Returns a bound location for the offset. Behavior is
   // undefined if `loc` does not represent a location in
@@ -97,19 +221,62 @@ public:
   // Returns a bound span for that given.
   Bound_span span(Span span) const { return {*this, span}; }
 
+  // Returns true if the buffer's text is a mapped region.
+  bool is_mapped() const { return (bool)map_; }
+
   // Iterators
-  char const* begin() const { return text_.c_str(); }
-  char const* end() const   { return begin() + text_.size(); }
+  char const* begin() const { return map_ ? map_.data() : text_.c_str(); }
+  char const* end() const   { return begin() + size(); }
+
+  // Returns the number of characters in the buffer. The
+  // padding is not included.
+  std::size_t size() const;
 
-  // String representation
-  String_view   rep() const { return {begin(), end()}; }
-  String const& str() const { return text_; }
+  // String representation. Note that str() returns a copy
+  // of the text.
+  String_view rep() const { return {begin(), end()}; }
+  String      str() const { return rep().str(); }
 
 protected:
-  String   text_;
+  virtual void acquire() const { }
+
+  int  column_in_line(int, int) const;
+  bool is_ascii_line(int) const;
+
+  String           text_;
+  Mapped_region    map_;
+  mutable Line_map lines_;
+
+  // Per-line flags indicating if a line is ASCII. Lines that
+  // have not been checked are unknown.
+  enum Line_encoding : char { unknown_line, ascii_line, utf8_line };
+  mutable std::vector<Line_encoding> enc_;
 };
 
 
+// Note that a buffer's string is empty only after it has been
+// moved from.
+inline std::size_t
+Buffer::size() const
+{
+  if (map_)
+    return map_.size();
+  return text_.empty() ? 0 : text_.size() - buffer_padding;
+}
+
+
+// Returns the line map for the buffer, building it if needed.
+// Note that a line map always contains at least one line.
+inline Line_map const&
+Buffer::lines() const
+{
+  acquire();
+  if (lines_.empty())
+    lines_ = Line_map(begin(), end());
+  return lines_;
+}
+
+
 // -------------------------------------------------------------------------- //
 //                               Input context
 //
@@ -117,14 +284,29 @@ protected:
 // input location for the purpose of simplifying diagnostics. This
 // prevents languages from having to continually pass these tokens
 // through the interface.
+//
+// Input locations are normally offsets in the input buffer. When the
+// input buffer is lexed with source locations (see Source_manager),
+// the input context must be established with the source manager, so
+// that diagnostics resolve locations in the right buffer.
+
+
+class Source_manager;
 
 
 Buffer& input_buffer();
 Location input_location();
+Source_manager const* input_source_manager();
 
 void set_input_buffer(Buffer&);
 void set_input_location(Location);
 
+Bound_location resolve_input(Location);
+Bound_span     resolve_input(Span);
+
+
+class Input_tracker;
+
 
 // The input context is a facility used to manage the
 // current input buffer and source location.
@@ -133,10 +315,140 @@ struct Input_context
   Input_context(Location);
   Input_context(Buffer&);
   Input_context(Buffer&, Location);
+  Input_context(Buffer&, Source_manager const&);
   ~Input_context();
 
-  Buffer*  saved_buf;
-  Location saved_loc;
+  Buffer*               saved_buf;
+  Location              saved_loc;
+  bool                  saved_tracking;
+  Source_manager const* saved_sm;
+};
+
+
+// -------------------------------------------------------------------------- //
+//                              Input trackers
+//
+// Setting the input location for every character or token that is
+// read is costly, since it writes a global in the innermost loop of
+// lexing and parsing. Instead, a stream can register an input tracker
+// that computes the input location from the stream's position when
+// it is requested (e.g., when a diagnostic is emitted).
+//
+// The tracker of the stream that read most recently determines the
+// input location, as it would if each stream set the location as it
+// read. A stream marks its tracker active when it reads; this only
+// writes to the global input context when the reading stream changes,
+// e.g., when a lexer reads characters on behalf of a token stream.
+// An explicit location or a new input context overrides the trackers
+// until a stream reads again.
+//
+// Trackers may be destroyed in any order. If the active tracker is
+// destroyed, the most recently registered tracker that remains
+// determines the input location.
+
+
+// A function that returns the input location for an object.
+using Input_location_fn = Location (*)(void const*);
+
+
+// An input tracker registers an object as the source of the input
+// location while the tracker exists.
+//
+// Trackers are members of the objects they register, so they are
+// copied and moved with the object that contains them, which passes
+// its own address. A copy is registered as a new tracker. A moved-to
+// tracker takes the place of the moved-from tracker, which is no
+// longer registered, and is active if the moved-from tracker was.
+// Assigning a tracker does not change its registration.
+class Input_tracker
+{
+public:
+  Input_tracker(Input_location_fn, void const*);
+  Input_tracker(Input_tracker const&, void const*);
+  Input_tracker(Input_tracker&&, void const*);
+  ~Input_tracker();
+
+  Input_tracker(Input_tracker const&) = delete;
+  Input_tracker& operator=(Input_tracker const&) { return *this; }
+
+  Location location() const { return fn_(obj_); }
+
+  // Called by a stream each time it reads an element.
+  void activate() { if (!active_) make_active(); }
+
+private:
+  friend class Tracker_suspension;
+  friend Location input_location();
+  friend void set_input_location(Location);
+
+  void make_active();
+  void link();
+  void unlink();
+
+  Input_location_fn fn_;
+  void const*       obj_;       // The object, or null if not registered
+  Input_tracker*    below_;     // The previously registered tracker
+  Input_tracker*    above_;     // The next registered tracker
+  bool              active_;    // True if the stream read most recently
+  bool              suspended_;
+};
+
+
+// A tracker suspension skips a tracker when computing the input
+// location while the suspension exists. This allows a stream to
+// read from another stream (e.g., a lazy token stream calling the
+// lexer) without hiding its locations. If the tracker was active,
+// it is made active again when the suspension ends, unless the
+// input location was set explicitly in the meantime.
+class Tracker_suspension
+{
+public:
+  explicit Tracker_suspension(Input_tracker&);
+  ~Tracker_suspension();
+
+  Tracker_suspension(Tracker_suspension const&) = delete;
+  Tracker_suspension& operator=(Tracker_suspension const&) = delete;
+
+private:
+  Input_tracker& tracker_;
+  bool           active_;
+};
+
+
+// Location tracking policies for streams. With eager tracking, a
+// stream sets the input location each time an element is read. With
+// lazy tracking, the stream registers an input tracker that computes
+// the location of the last element read when it is needed, and marks
+// it active when it reads.
+//
+// A stream copies or moves its policy by passing the policy of the
+// other stream along with its own address.
+struct Eager_tracking
+{
+  Eager_tracking(Input_location_fn, void const*) { }
+  Eager_tracking(Eager_tracking const&, void const*) { }
+
+  void update(Location loc) { set_input_location(loc); }
+};
+
+
+struct Lazy_tracking
+{
+  Lazy_tracking(Input_location_fn f, void const* p)
+    : tracker(f, p)
+  { }
+
+  Lazy_tracking(Lazy_tracking const& t, void const* p)
+    : tracker(t.tracker, p)
+  { }
+
+  Lazy_tracking(Lazy_tracking&& t, void const* p)
+    : tracker(std::move(t.tracker), p)
+  { }
+
+  void update(Location) { tracker.activate(); }
+
+  Input_tracker tracker;
 };
 
 
@@ -0,0 +1,230 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#include "file.hpp"
+#include "symbol.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include <unistd.h>
+
+// This file implements the token cache of the file manager (see
+// File_manager::tokens).
+
+namespace lingo
+{
+
+namespace
+{
+
+// Identifies cache entries and their format.
+constexpr char magic_[8] = {'l', 'i', 'n', 'g', 'o', 't', 'o', 'k'};
+constexpr std::uint32_t format_ = 4;
+
+
+// The header of a cache entry. The header is followed by the
+// spelling table and then the tokens.
+//
+// A spelling is stored as its token kind and length followed by
+// its characters. A token is stored as its offset and the index 
+// of its spelling. Offsets are relative to the start of the file.
+struct Header
+{
+  char          magic[8];
+  std::uint32_t format;
+  std::uint32_t symbols;
+  std::uint64_t tokens;
+  std::uint64_t version;
+  std::uint64_t size;
+  std::uint64_t hash;
+};
+
+
+struct Spelling
+{
+  std::int32_t  kind;
+  std::uint32_t len;
+};
+
+
+struct Token_rep
+{
+  std::int32_t  offset;
+  std::uint32_t symbol;
+};
+
+
+// Returns the path of the cache entry for the given file in the
+// cache directory `dir`. Entries are named by a hash of the file's
+// path.
+Path
+entry_path(Path const& dir, File const& file)
+{
+  std::string const& p = file.path().native();
+  std::stringstream ss;
+  ss << std::hex << hash_bytes(p.data(), p.data() + p.size()) << ".tok";
+  return dir / ss.str();
+}
+
+
+// Read an object of type T at `p`, advancing `p`. Returns false if
+// there are not enough characters before `last`.
+template<typename T>
+inline bool
+read(char const*& p, char const* last, T& x)
+{
+  if (last - p < (std::ptrdiff_t)sizeof(T))
+    return false;
+  std::memcpy(&x, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+
+template<typename T>
+inline void
+write(std::ostream& os, T const& x)
+{
+  os.write(reinterpret_cast<char const*>(&x), sizeof(T));
+}
+
+
+} // namespace
+
+
+// Enable the token cache, storing entries in the given directory.
+// The directory is created if it does not exist.
+void
+File_manager::set_token_cache(Path const& dir)
+{
+  create_directories(dir);
+  cache_ = dir;
+}
+
+
+// Disable the token cache.
+void
+File_manager::disable_token_cache()
+{
+  cache_.clear();
+}
+
+
+// If the token cache contains a valid entry for `file`, append its
+// tokens to `toks`, with locations starting at `start`, and return
+// true. Otherwise, return false.
+//
+// The contents of the file are always hashed and compared with the
+// entry. Modification times are too coarse to detect a file that is
+// rewritten with the same size shortly after it was cached.
+bool
+File_manager::read_tokens(File const& file, Location start, Token_list& toks) const
+{
+  if (cache_.empty())
+    return false;
+  Path path = entry_path(cache_, file);
+  Mapped_region entry(path.c_str());
+  if (!entry)
+    return false;
+
+  char const* p = entry.data();
+  char const* last = p + entry.size();
+  Header h;
+  if (!read(p, last, h))
+    return false;
+  if (std::memcmp(h.magic, magic_, sizeof(magic_)) != 0 || h.format != format_)
+    return false;
+  if (h.version != token_set_version() || h.size != file.size())
+    return false;
+  if (h.hash != hash_bytes(file.begin(), file.end()))
+    return false;
+
+  // Re-intern the spellings.
+  std::vector<Symbol*> syms;
+  syms.reserve(h.symbols);
+  for (std::uint32_t i = 0; i != h.symbols; ++i) {
+    Spelling s;
+    if (!read(p, last, s) || std::size_t(last - p) < s.len)
+      return false;
+    syms.push_back(&get_symbol(p, p + s.len, s.kind));
+    p += s.len;
+  }
+
+  // Rebuild the tokens.
+  if (std::uint64_t(last - p) / sizeof(Token_rep) < h.tokens)
+    return false;
+  std::size_t n = toks.size();
+  toks.reserve(n + h.tokens);
+  for (std::uint64_t i = 0; i != h.tokens; ++i) {
+    Token_rep t;
+    read(p, last, t);
+    if (t.symbol >= syms.size() || t.offset < 0 || std::uint64_t(t.offset) > h.size) {
+      toks.resize(n);
+      return false;
+    }
+    toks.push_back(Token(Location(start.offset() + t.offset), *syms[t.symbol]));
+  }
+  return true;
+}
+
+
+// Save the tokens [first, last) of `file`, whose locations start at
+// `start`, in the token cache. The entry is written to a temporary
+// file and then renamed, so concurrent readers never see a partial
+// entry. Errors are ignored, but the temporary file is removed.
+void
+File_manager::write_tokens(File const& file, Location start, Token const* first, Token const* last) const
+{
+  if (cache_.empty())
+    return;
+
+  // Assign an index to each distinct symbol.
+  std::unordered_map<Symbol const*, std::uint32_t> index;
+  std::vector<Symbol const*> syms;
+  for (Token const* p = first; p != last; ++p) {
+    if (index.insert({&p->symbol(), syms.size()}).second)
+      syms.push_back(&p->symbol());
+  }
+
+  Header h;
+  std::memcpy(h.magic, magic_, sizeof(magic_));
+  h.format = format_;
+  h.symbols = syms.size();
+  h.tokens = last - first;
+  h.version = token_set_version();
+  h.size = file.size();
+  h.hash = hash_bytes(file.begin(), file.end());
+
+  Path path = entry_path(cache_, file);
+  Path temp = path;
+  temp += "." + std::to_string(::getpid());
+  {
+    std::ofstream os(temp.native(), std::ios::binary);
+    write(os, h);
+    for (Symbol const* sym : syms) {
+      write(os, Spelling {sym->kind, (std::uint32_t)sym->str.size()});
+      os.write(sym->str.begin(), sym->str.size());
+    }
+    for (Token const* p = first; p != last; ++p) {
+      int off = p->location().offset() - start.offset();
+      write(os, Token_rep {off, index[&p->symbol()]});
+    }
+    os.close();
+    if (!os) {
+      boost::system::error_code err;
+      remove(temp, err);
+      return;
+    }
+  }
+  boost::system::error_code err;
+  rename(temp, path, err);
+  if (err)
+    remove(temp, err);
+}
+
+
+} // namespace lingo
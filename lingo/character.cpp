@@ -4,54 +4,160 @@
 #include "character.hpp"
 #include "error.hpp"
 
-// TODO: Let L be the number of lines in a file. The current
-// implementation maintains a mapping of lines using an 
-// sorted structure to support line lookup of offsets. However,
-// we don't actually need to maintain that mapping until we
-// start issuing lookups against it. 
-//
-// We could run a translation phase that builds the line map
-// prior to whatever phase is happening here.
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+// Note that character streams do not maintain the line map
+// of their buffer. The buffer builds its line map the first time
+// a location is resolved to a line (e.g., when emitting a
+// diagnostic), so lexing never pays for line resolution.
 
 namespace lingo
 {
 
-// Returns a reference to the current character. Note
-// that the stream must not be at the end of the file.
+// -------------------------------------------------------------------------- //
+//                          File character stream
+
+constexpr int File_character_stream::lookahead;
+
+
+// Initialize the stream to read from the file descriptor `fd`
+// with the given window size. The stream does not own the file
+// descriptor. The buffer holds twice the window, so that a token
+// can grow past the window without moving any characters.
+File_character_stream::File_character_stream(int fd, int window)
+  : fd_(fd), 
+    window_(window), 
+    buf_(new char[2 * window]), 
+    cap_(buf_ + 2 * window),
+    mark_(nullptr),
+    first_(buf_), 
+    last_(buf_),
+    base_(0),
+    done_(false)
+{
+  lingo_assert(window > lookahead);
+  fill(window_);
+}
+
+
+File_character_stream::~File_character_stream()
+{
+  delete [] buf_;
+}
+
+
+// Returns a reference to the current character. Note that the
+// stream must not be at the end of the file.
 char const&
-Character_stream::peek() const
+File_character_stream::peek() const
 {
   lingo_assert(!eof());
   return *first_;
 }
 
 
-// Returns the nth caracter past the curent position.
-// If the nth caracter is past the end of the file, then
-// this returns the null character.
+// Returns the nth character past the current position. If the
+// nth character is past the end of the file, then this returns
+// the null character.
 char
-Character_stream::peek(int n) const
+File_character_stream::peek(int n) const
 {
-  lingo_assert(!eof());
+  lingo_assert(!eof() && n < lookahead);
   if (n >= (last_ - first_))
     return 0;
   return *(first_ + n);
 }
 
 
-// Returns a pointer to the current element and advances
-// the stream position to the next character. This also
-// checks to see if we've advanced over a newline and
-// updates the source location as needed.
+// Returns a reference to the current character and advances the
+// stream. If no more than `lookahead` characters remain in the
+// window, more are read first (see refill), so at least `lookahead`
+// characters can be seen after the returned character.
 char const&
-Character_stream::get()
+File_character_stream::get()
 {
   lingo_assert(!eof());
+  if (last_ - first_ <= lookahead && !done_)
+    refill();
+  return *first_++;
+}
 
-  // Save the current location as the input location.
-  set_input_location(location());
 
-  return *first_++;
+// Start a token at the current position. This releases the
+// characters before the current position. If fewer than `window`
+// characters are buffered, the remaining characters are moved to
+// the front of the buffer and the buffer is refilled. This
+// invalidates all pointers into the stream.
+void
+File_character_stream::mark()
+{
+  if (!done_ && last_ - first_ < window_) {
+    slide(first_);
+    fill(window_);
+  }
+  mark_ = first_;
+}
+
+
+// End the current token, releasing its characters. Until the
+// next mark, the window may slide past them.
+void
+File_character_stream::discard()
+{
+  mark_ = nullptr;
+}
+
+
+// Read more characters into the window. If the window is full and
+// no token is marked, the characters from the current position are
+// first moved to the front of the buffer. A marked token is never
+// moved, since that would invalidate pointers into it, so a full
+// window with a mark means that the token is too long and lexing
+// is aborted.
+void
+File_character_stream::refill()
+{
+  if (last_ == cap_) {
+    lingo_alert(!mark_, "token exceeds stream window");
+    slide(first_);
+    fill(window_);
+  } else {
+    fill(lookahead + 1);
+  }
+}
+
+
+// Move the characters from `p` to the end of the buffered
+// characters to the front of the buffer.
+void
+File_character_stream::slide(char const* p)
+{
+  std::size_t n = last_ - p;
+  std::memmove(buf_, p, n);
+  base_ += p - buf_;
+  first_ = buf_ + (first_ - p);
+  last_ = buf_ + n;
+}
+
+
+// Read from the input until at least `n` characters are buffered
+// past the current position, the window is full, or the input is
+// exhausted. Read errors are treated as the end of input.
+void
+File_character_stream::fill(int n)
+{
+  while (!done_ && last_ != cap_ && last_ - first_ < n) {
+    ssize_t k = ::read(fd_, last_, cap_ - last_);
+    if (k < 0 && errno == EINTR)
+      continue;
+    if (k <= 0)
+      done_ = true;
+    else
+      last_ += k;
+  }
 }
 
 
@@ -7,6 +7,9 @@
 #include "lingo/location.hpp"
 #include "lingo/buffer.hpp"
 #include "lingo/string.hpp"
+#include "lingo/error.hpp"
+
+#include <cassert>
 
 namespace lingo
 {
@@ -25,24 +28,52 @@ class Buffer;
 //
 // Note that as a general rule for streams, &s.peek() == s.begin().
 //
+// By default, locations are offsets from the start of the stream.
+// A stream can be given a start location, which is added to each
+// offset. In particular, giving the base location of a buffer in
+// the source manager produces source locations (see Source_manager).
+//
+// The tracking policy determines how the stream maintains the input
+// location, which is the location of the last character read (see
+// Eager_tracking and Lazy_tracking). By default, the input location
+// is computed only when it is needed, so get() does not write to the
+// global input context. A copy of a stream tracks its own position,
+// and a moved-to stream takes over the tracking of the moved-from
+// stream (see Input_tracker).
+//
 // Hypothetically, the null() function is a mechanism for creating
 // a value that contextually evaluates to false upon default construction.
 // This is a stronger concept than the NullablePointer concept.
-class Character_stream
+template<typename Tracking>
+class Basic_character_stream
 {
 public:
   using value_type = char;
 
-  Character_stream(Buffer& b, char const* f, char const* l)
-    : buf_(b), base_(f), first_(f), last_(l)
+  Basic_character_stream(Buffer& b, char const* f, char const* l)
+    : buf_(b), base_(f), first_(f), last_(l), start_(0), track_(&input_location_of, this)
   { }
 
-  Character_stream(Buffer& b, String const& s)
-    : Character_stream(b, s.data(), s.data() + s.size())
+  Basic_character_stream(Buffer& b, String const& s)
+    : Basic_character_stream(b, s.data(), s.data() + s.size())
   { }
 
-  Character_stream(Buffer& b)
-    : Character_stream(b, b.begin(), b.end())
+  Basic_character_stream(Buffer& b)
+    : Basic_character_stream(b, b.begin(), b.end())
+  { }
+
+  Basic_character_stream(Buffer& b, Location start)
+    : Basic_character_stream(b)
+  { start_ = start.offset(); }
+
+  Basic_character_stream(Basic_character_stream const& s)
+    : buf_(s.buf_), base_(s.base_), first_(s.first_), last_(s.last_)
+    , start_(s.start_), track_(s.track_, this)
+  { }
+
+  Basic_character_stream(Basic_character_stream&& s)
+    : buf_(s.buf_), base_(s.base_), first_(s.first_), last_(s.last_)
+    , start_(s.start_), track_(std::move(s.track_), this)
   { }
 
   // Stream control
@@ -58,18 +89,224 @@ public:
   char const* end() const { return last_; }
 
   // Locations
-  Location location() const { return Location(offset()); }
+  Location location() const { return Location(start_ + offset()); }
 
   // Buffer
   Buffer const& buffer() const { return buf_; }
 
-private:
+protected:
   int offset() const { return first_ - base_; }
+
+  static Location input_location_of(void const*);
   
-  Buffer&       buf_;  // The stream's source file
+  Buffer&       buf_;   // The stream's source file
   char const*   base_;  // The beginning of the stream
   char const*   first_; // Current character pointer
   char const*   last_;  // Past the end of the character buffer
+  int           start_; // The location of the first character
+  Tracking      track_; // Input location tracking
+};
+
+
+// A character stream that sets the input location for each
+// character read.
+using Eager_character_stream = Basic_character_stream<Eager_tracking>;
+
+
+// A character stream that computes the input location lazily.
+using Character_stream = Basic_character_stream<Lazy_tracking>;
+
+
+// Returns a reference to the current character. Note
+// that the stream must not be at the end of the file.
+template<typename T>
+inline char const&
+Basic_character_stream<T>::peek() const
+{
+  lingo_assert(!eof());
+  return *first_;
+}
+
+
+// Returns the nth caracter past the curent position.
+// If the nth caracter is past the end of the file, then
+// this returns the null character.
+template<typename T>
+inline char
+Basic_character_stream<T>::peek(int n) const
+{
+  lingo_assert(!eof());
+  if (n >= (last_ - first_))
+    return 0;
+  return *(first_ + n);
+}
+
+
+// Returns a pointer to the current element and advances
+// the stream position to the next character. With eager
+// tracking, the character's location is saved as the input
+// location.
+template<typename T>
+inline char const&
+Basic_character_stream<T>::get()
+{
+  lingo_assert(!eof());
+  track_.update(location());
+  return *first_++;
+}
+
+
+// Returns the location of the last character read from the
+// stream `p`, or no location if no characters have been read.
+template<typename T>
+Location
+Basic_character_stream<T>::input_location_of(void const* p)
+{
+  Basic_character_stream const& s = *static_cast<Basic_character_stream const*>(p);
+  if (s.first_ == s.base_)
+    return Location::none;
+  return Location(s.start_ + s.offset() - 1);
+}
+
+
+// An unchecked character stream reads the text of a buffer without
+// checking for the end of the stream. It relies on the null character
+// and padding that follow the text of every buffer (see Buffer): at
+// the end of the stream, peek() returns the null character, and
+// peek(n) returns 0 for any n up to buffer_padding past the end.
+//
+// The null character is the stream's sentinel. The algorithms
+// in algorithm.hpp only check for the end of a stream with a
+// sentinel when the current character is the sentinel, so loops
+// over predicates that reject it (e.g., is_space, is_decimal_digit,
+// is_identifier_rest) test one character per iteration. Note that
+// the null character may also occur in the text.
+//
+// Note that get() must not be called at the end of the stream.
+template<typename Tracking>
+class Basic_unchecked_character_stream : public Basic_character_stream<Tracking>
+{
+  using Base = Basic_character_stream<Tracking>;
+public:
+  static constexpr char sentinel = 0;
+
+  Basic_unchecked_character_stream(Buffer& b)
+    : Base(b)
+  { }
+
+  Basic_unchecked_character_stream(Buffer& b, Location start)
+    : Base(b, start)
+  { }
+
+  // Stream control
+  char const& peek() const { return *this->first_; }
+  char        peek(int) const;
+  char const& get();
+};
+
+
+// An unchecked character stream that computes the input location
+// lazily.
+using Unchecked_character_stream = Basic_unchecked_character_stream<Lazy_tracking>;
+
+
+template<typename T>
+constexpr char Basic_unchecked_character_stream<T>::sentinel;
+
+
+// Returns the nth character past the current position. Characters
+// past the end of the stream are 0.
+template<typename T>
+inline char
+Basic_unchecked_character_stream<T>::peek(int n) const
+{
+  assert(n <= (int)buffer_padding);
+  return this->first_[n];
+}
+
+
+// Returns a reference to the current character and advances the
+// stream.
+template<typename T>
+inline char const&
+Basic_unchecked_character_stream<T>::get()
+{
+  assert(!this->eof());
+  this->track_.update(this->location());
+  return *this->first_++;
+}
+
+
+// A file character stream reads characters from a file descriptor
+// through a fixed-size window, so that inputs of any size can be
+// lexed in constant memory. Its interface is the same as that of
+// the character stream, except that its locations are wide
+// locations, and that it has no buffer.
+//
+// A lexer calls mark() at the start of each token whose characters
+// it needs (e.g., an identifier), and discard() once the token has
+// been built. Pointers to characters at or after the mark (e.g.,
+// those returned by begin() or get()) remain valid until the next
+// call to mark() or discard(). The characters of a token are always
+// contiguous. A token may contain up to `window - lookahead`
+// characters. Because a marked token is never moved, a file that
+// contains a longer token cannot be lexed with this stream; reading
+// past that limit aborts.
+//
+// When no token is marked, get() slides the window over the input
+// as needed, so skipping over comments or white space of any length
+// does not require a mark. In that case, a pointer into the stream
+// remains valid only until the next call to get().
+//
+// Lookahead via peek(n) is bounded: peek(n) is valid for n < lookahead.
+//
+// Note that the stream does not update the input location.
+class File_character_stream
+{
+public:
+  using value_type = char;
+
+  static constexpr int lookahead = 16;
+
+  explicit File_character_stream(int, int = 1 << 16);
+  ~File_character_stream();
+
+  File_character_stream(File_character_stream const&) = delete;
+  File_character_stream& operator=(File_character_stream const&) = delete;
+
+  // Stream control
+  bool        eof() const     { return first_ == last_; }
+  char const& peek() const;
+  char        peek(int) const;
+  char const& get();
+
+  // Tokens
+  void        mark();
+  void        discard();
+
+  // Iterators
+  char const* begin()       { return first_; }
+  char const* begin() const { return first_; }
+  char const* end()       { return last_; }
+  char const* end() const { return last_; }
+
+  // Locations
+  Wide_location location() const { return Wide_location(base_ + (first_ - buf_)); }
+
+private:
+  void refill();
+  void slide(char const*);
+  void fill(int);
+
+  int          fd_;     // The input file descriptor
+  int          window_; // The minimum number of buffered characters
+  char*        buf_;    // The window
+  char*        cap_;    // Past the end of the window
+  char const*  mark_;   // The start of the marked token, if any
+  char const*  first_;  // Current character pointer
+  char*        last_;   // Past the end of buffered characters
+  std::int64_t base_;   // Offset of the first character in the window
+  bool         done_;   // True when the input is exhausted
 };
 
 } // namespace lingo
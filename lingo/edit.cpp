@@ -0,0 +1,407 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#include "edit.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+
+namespace lingo
+{
+
+// -------------------------------------------------------------------------- //
+//                                 Edits
+
+// Returns the location of `loc` after the edit `e` has been
+// applied. Locations before the edit are unchanged, and those
+// after the edited range are shifted by the change in length.
+// Locations within the removed text are moved to the start of
+// the edit.
+Location
+remap(Location loc, Edit const& e)
+{
+  if (!loc)
+    return loc;
+  int off = loc.offset();
+  if (off < e.offset)
+    return loc;
+  if (off < e.offset + e.removed)
+    return Location(e.offset);
+  return Location(off - e.removed + e.inserted);
+}
+
+
+// Returns the span `s` after the edit `e` has been applied.
+Span
+remap(Span s, Edit const& e)
+{
+  return {remap(s.start(), e), remap(s.end(), e)};
+}
+
+
+// -------------------------------------------------------------------------- //
+//                              Edit buffers
+
+// A node in the piece tree. A piece refers to the characters
+// [start, start + length) of either the original (source 0) or
+// inserted (source 1) text.
+struct Edit_buffer::Node
+{
+  int      source;
+  int      start;
+  int      length;
+  int      newlines;       // Newlines in the piece
+  unsigned priority;
+  Node*    left;
+  Node*    right;
+  int      total_length;   // Characters in the subtree
+  int      total_newlines; // Newlines in the subtree
+};
+
+
+namespace
+{
+
+using Node = Edit_buffer::Node;
+
+
+inline int
+length(Node const* t)
+{
+  return t ? t->total_length : 0;
+}
+
+
+inline int
+newlines(Node const* t)
+{
+  return t ? t->total_newlines : 0;
+}
+
+
+// Recompute the subtree totals of `t`.
+inline void
+update(Node* t)
+{
+  t->total_length = length(t->left) + t->length + length(t->right);
+  t->total_newlines = newlines(t->left) + t->newlines + newlines(t->right);
+}
+
+
+// Join two trees where every piece in `a` precedes those in `b`.
+Node*
+merge(Node* a, Node* b)
+{
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  if (a->priority >= b->priority) {
+    a->right = merge(a->right, b);
+    update(a);
+    return a;
+  } else {
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+  }
+}
+
+
+void
+destroy(Node* t)
+{
+  if (t) {
+    destroy(t->left);
+    destroy(t->right);
+    delete t;
+  }
+}
+
+
+// Append the text of the pieces in `t` to `str`.
+void
+append(String& str, Node const* t, String const* text)
+{
+  if (t) {
+    append(str, t->left, text);
+    str.append(text[t->source], t->start, t->length);
+    append(str, t->right, text);
+  }
+}
+
+// Returns the number of UTF-8 continuation bytes in the characters
+// [first, last) of the pieces in `t`. Only the pieces that overlap
+// the range are visited.
+int
+continuations(Node const* t, String const* text, int first, int last)
+{
+  if (!t || first >= last)
+    return 0;
+  int n = 0;
+  int l = length(t->left);
+  if (first < l)
+    n += continuations(t->left, text, first, std::min(last, l));
+  int f = std::max(first - l, 0);
+  int e = std::min(last - l, t->length);
+  if (f < e) {
+    char const* p = text[t->source].data() + t->start;
+    n += count_continuations(p + f, p + e);
+  }
+  int r = l + t->length;
+  if (last > r)
+    n += continuations(t->right, text, std::max(first - r, 0), last - r);
+  return n;
+}
+
+} // namespace
+
+
+Edit_buffer::Edit_buffer()
+  : root_(nullptr), seed_(2463534242u)
+{
+  lines_[1].start_line(0);
+}
+
+
+// Initialize the buffer with a copy of the given text.
+Edit_buffer::Edit_buffer(String const& str)
+  : Edit_buffer(String(str))
+{ }
+
+
+// Initialize the buffer by taking ownership of the given text.
+Edit_buffer::Edit_buffer(String&& str)
+  : Edit_buffer()
+{
+  text_[0] = std::move(str);
+  lines_[0] = Line_map(text_[0].data(), text_[0].data() + text_[0].size());
+  if (!text_[0].empty())
+    root_ = make_piece(0, 0, text_[0].size());
+}
+
+
+Edit_buffer::~Edit_buffer()
+{
+  destroy(root_);
+}
+
+
+// Returns the number of characters in the buffer.
+int
+Edit_buffer::size() const
+{
+  return length(root_);
+}
+
+
+// Returns the number of lines in the buffer. There is always
+// at least one line.
+int
+Edit_buffer::line_count() const
+{
+  return newlines(root_) + 1;
+}
+
+
+// Returns the line number of the given location. This counts
+// the newlines preceding the location.
+int
+Edit_buffer::line_no(Location loc) const
+{
+  int off = loc.offset();
+  int n = 0;
+  Node const* t = root_;
+  while (t) {
+    if (off < length(t->left)) {
+      t = t->left;
+      continue;
+    }
+    off -= length(t->left);
+    n += newlines(t->left);
+    if (off < t->length) {
+      n += count_newlines(t->source, t->start, t->start + off);
+      break;
+    }
+    off -= t->length;
+    n += t->newlines;
+    t = t->right;
+  }
+  return n + 1;
+}
+
+
+// Returns the column number of the given location. As for
+// buffers, this counts UTF-8 encoded characters, not bytes.
+int
+Edit_buffer::column_no(Location loc) const
+{
+  int first = line_offset(line_no(loc) - 1);
+  int off = loc.offset();
+  return off - first - continuations(root_, text_, first, off) + 1;
+}
+
+
+// Returns the offset of the first character of the nth line,
+// counting from 0. This is the offset past the nth newline.
+int
+Edit_buffer::line_offset(int n) const
+{
+  lingo_assert(0 <= n && n < line_count());
+  int off = 0;
+  Node const* t = root_;
+  while (n != 0) {
+    if (n <= newlines(t->left)) {
+      t = t->left;
+      continue;
+    }
+    n -= newlines(t->left);
+    off += length(t->left);
+    if (n <= t->newlines) {
+      // The nth newline is in this piece.
+      Line_map const& lines = lines_[t->source];
+      int first = lines.line_index(Location(t->start));
+      return off + lines.line_offset(first + n) - t->start;
+    }
+    n -= t->newlines;
+    off += t->length;
+    t = t->right;
+  }
+  return off;
+}
+
+
+// Returns a string containing the text of the buffer.
+String
+Edit_buffer::str() const
+{
+  String str;
+  str.reserve(size());
+  append(str, root_, text_);
+  return str;
+}
+
+
+// Insert the text `s` at the given offset. Only the inserted
+// characters are scanned for newlines.
+Edit
+Edit_buffer::insert(int off, String_view s)
+{
+  lingo_assert(0 <= off && off <= size());
+  if (s.size() == 0)
+    return {off, 0, 0};
+
+  // Append the text to the inserted text and record its lines.
+  String& add = text_[1];
+  int start = add.size();
+  add.append(s.begin(), s.end());
+  for (int i = start; i != (int)add.size(); ++i) {
+    if (add[i] == '\n')
+      lines_[1].start_line(i + 1);
+  }
+
+  Node* left;
+  Node* right;
+  split(root_, off, left, right);
+  root_ = merge(merge(left, make_piece(1, start, s.size())), right);
+  return {off, 0, s.size()};
+}
+
+
+// Erase the `n` characters starting at the given offset.
+Edit
+Edit_buffer::erase(int off, int n)
+{
+  lingo_assert(0 <= off && 0 <= n && off + n <= size());
+  Node* left;
+  Node* mid;
+  Node* right;
+  split(root_, off, left, right);
+  split(right, n, mid, right);
+  destroy(mid);
+  root_ = merge(left, right);
+  return {off, n, 0};
+}
+
+
+// Replace the `n` characters starting at the given offset
+// with the text `s`.
+Edit
+Edit_buffer::replace(int off, int n, String_view s)
+{
+  erase(off, n);
+  insert(off, s);
+  return {off, n, s.size()};
+}
+
+
+// Allocate a new piece with a random priority.
+Edit_buffer::Node*
+Edit_buffer::make_piece(int src, int start, int len)
+{
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  int nl = count_newlines(src, start, start + len);
+  return new Node {src, start, len, nl, seed_, nullptr, nullptr, len, nl};
+}
+
+
+// Returns the number of newlines in the characters [first, last)
+// of the given source text. Every newline at position p starts
+// a line at p + 1.
+int
+Edit_buffer::count_newlines(int src, int first, int last) const
+{
+  Line_map const& lines = lines_[src];
+  return lines.line_index(Location(last)) - lines.line_index(Location(first));
+}
+
+
+// Split the tree `t` so that `left` contains the first `off`
+// characters and `right` contains the rest. A piece spanning
+// the split point is divided in two.
+void
+Edit_buffer::split(Node* t, int off, Node*& left, Node*& right)
+{
+  if (!t) {
+    left = right = nullptr;
+    return;
+  }
+  int n = length(t->left);
+  if (off <= n) {
+    split(t->left, off, left, t->left);
+    update(t);
+    right = t;
+  } else if (off >= n + t->length) {
+    split(t->right, off - n - t->length, t->right, right);
+    update(t);
+    left = t;
+  } else {
+    right = split_piece(t, off - n);
+    left = t;
+  }
+}
+
+
+// Divide the piece at `t` so that it retains its first `n`
+// characters and its left subtree. Returns a new node containing
+// the remaining characters and the right subtree. The new node
+// shares the priority of `t` so that both remain valid treaps.
+Edit_buffer::Node*
+Edit_buffer::split_piece(Node* t, int n)
+{
+  int start = t->start + n;
+  int len = t->length - n;
+  int nl = count_newlines(t->source, start, start + len);
+  Node* rest = new Node {t->source, start, len, nl, t->priority, nullptr, t->right, 0, 0};
+  t->length = n;
+  t->newlines -= nl;
+  t->right = nullptr;
+  update(t);
+  update(rest);
+  return rest;
+}
+
+
+} // namespace lingo
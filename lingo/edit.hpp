@@ -0,0 +1,103 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#ifndef LINGO_EDIT_HPP
+#define LINGO_EDIT_HPP
+
+// The edit module provides a mutable text buffer that supports
+// efficient insertion and deletion of text, and facilities for
+// updating source locations across those edits.
+
+#include "lingo/string.hpp"
+#include "lingo/location.hpp"
+#include "lingo/buffer.hpp"
+
+namespace lingo
+{
+
+// -------------------------------------------------------------------------- //
+//                                 Edits
+
+// An edit describes the replacement of `removed` characters
+// starting at `offset` with `inserted` characters. Insertions
+// remove no characters, and deletions insert none.
+struct Edit
+{
+  int offset;
+  int removed;
+  int inserted;
+};
+
+
+Location remap(Location, Edit const&);
+Span     remap(Span, Edit const&);
+
+
+// -------------------------------------------------------------------------- //
+//                              Edit buffers
+
+// An edit buffer is a piece table: the text is a sequence of
+// pieces, each of which refers to a range of characters in either
+// the original text or an append-only buffer of inserted text.
+// Pieces are stored in a balanced tree (a treap) ordered by text
+// position, so insertions and deletions take O(log n) time in the
+// number of pieces.
+//
+// Each node in the tree records the number of characters and
+// newlines in its subtree. Both the original and inserted texts
+// have a line map, which allows the number of newlines in a piece
+// to be computed without scanning it. An edit only scans the
+// characters it inserts, so the line structure of the buffer is
+// updated for the edited range only.
+//
+// Locations in an edit buffer are character offsets, as they are
+// for buffers. Use remap() to update locations after an edit. As for
+// buffers, column numbers count UTF-8 encoded characters.
+//
+// Note that the contents of an edit buffer must be copied into a
+// Buffer (see str()) in order to be lexed.
+class Edit_buffer
+{
+public:
+  struct Node;
+
+  Edit_buffer();
+  Edit_buffer(String const&);
+  Edit_buffer(String&&);
+
+  Edit_buffer(Edit_buffer const&) = delete;
+  Edit_buffer& operator=(Edit_buffer const&) = delete;
+
+  ~Edit_buffer();
+
+  // Observers
+  int size() const;
+  int line_count() const;
+
+  int line_no(Location) const;
+  int column_no(Location) const;
+  int line_offset(int) const;
+
+  String str() const;
+
+  // Mutators
+  Edit insert(int, String_view);
+  Edit erase(int, int);
+  Edit replace(int, int, String_view);
+
+private:
+  Node* make_piece(int, int, int);
+  int   count_newlines(int, int, int) const;
+  void  split(Node*, int, Node*&, Node*&);
+  Node* split_piece(Node*, int);
+
+  String   text_[2];  // The original and inserted text
+  Line_map lines_[2]; // Lines in the original and inserted text
+  Node*    root_;
+  unsigned seed_;
+};
+
+
+} // namespace lingo
+
+#endif
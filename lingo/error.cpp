@@ -82,7 +82,7 @@ char const* indent_ = "|    ";
 void
 show_line(std::ostream& os, Bound_location const& loc)
 {
-  Line const& line = loc.line();
+  Line line = loc.line();
   os << indent_ << line.str() << '\n';
   
   // Show the caret, but only if if the caret is valid.
@@ -98,7 +98,7 @@ show_line(std::ostream& os, Bound_location const& loc)
 void
 show_span(std::ostream& os, Bound_span const& span)
 {
-  Line const& line = span.line();
+  Line line = span.line();
   os << indent_ << line.str() << '\n';
 
   // TODO: Do something better than this. We could print
@@ -284,6 +284,16 @@ error(Bound_span span, String const& msg)
 }
 
 
+// Emit an error diagnostic at the given offset in a streamed
+// input. The diagnostic has no source location.
+void
+error(Wide_location loc, String const& msg)
+{
+  String str = "offset " + std::to_string(loc.offset()) + ": " + msg;
+  diags_.top()->emit({error_diag, Bound_location(), str});
+}
+
+
 // Emit a warning diagnostic at the given source location.
 //
 // TODO: Allow warnings to be treated as errors? This
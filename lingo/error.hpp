@@ -189,6 +189,7 @@ int error_count();
 
 void error(Bound_location, String const&);
 void error(Bound_span, String const&);
+void error(Wide_location, String const&);
 
 void warning(Bound_location, String const&);
 void warning(Bound_span, String const&);
@@ -253,23 +254,23 @@ error(Buffer const& buf, Caret caret, char const* msg, Ts const&... args)
 }
 
 
-// Emit an error diagnostic using the current buffer to resolve
+// Emit an error diagnostic using the input context to resolve
 // the source code location.
 template<typename... Ts>
 inline void
 error(Location loc, char const* msg, Ts const&... args)
 {
-  error(input_buffer(), loc, msg, args...);
+  error(resolve_input(loc), format(msg, to_string(args)...));
 }
 
 
-// Emit an error diagnostic using the current buffer to resolve
+// Emit an error diagnostic using the input context to resolve
 // the source code span.
 template<typename... Ts>
 inline void
 error(Span span, char const* msg, Ts const&... args)
 {
-  error(input_buffer(), span, msg, args...);
+  error(resolve_input(span), format(msg, to_string(args)...));
 }
 
 
@@ -278,7 +279,18 @@ template<typename... Ts>
 inline void
 error(char const* msg, Ts const&... args)
 {
-  error(input_buffer(), input_location(), msg, args...);
+  error(resolve_input(input_location()), format(msg, to_string(args)...));
+}
+
+
+// Emit an error diagnostic at a location in a streamed input.
+// The location cannot be resolved to a line, so the offset of
+// the character is reported with the message.
+template<typename... Ts>
+inline void
+error(Wide_location loc, char const* msg, Ts const&... args)
+{
+  error(loc, format(msg, to_string(args)...));
 }
 
 
@@ -294,23 +306,23 @@ warning(Buffer& buf, Caret caret, char const* msg, Ts const&... args)
 }
 
 
-// Emit a warning diagnostic using the current buffer to resolve
+// Emit a warning diagnostic using the input context to resolve
 // the source code location.
 template<typename... Ts>
 inline void
 warning(Location loc, char const* msg, Ts const&... args)
 {
-  warning(input_buffer(), loc, msg, args...);
+  warning(resolve_input(loc), format(msg, to_string(args)...));
 }
 
 
-// Emit a warning diagnostic using the current buffer to resolve
+// Emit a warning diagnostic using the input context to resolve
 // the source code location.
 template<typename... Ts>
 inline void
 warning(Span span, char const* msg, Ts const&... args)
 {
-  warning(input_buffer(), span, msg, args...);
+  warning(resolve_input(span), format(msg, to_string(args)...));
 }
 
 
@@ -319,7 +331,7 @@ template<typename... Ts>
 inline void
 warning(char const* msg, Ts const&... args)
 {
-  warning(input_buffer(), input_location(), msg, args...);
+  warning(resolve_input(input_location()), format(msg, to_string(args)...));
 }
 
 
@@ -335,23 +347,23 @@ note(Buffer& buf, Caret caret, char const* msg, Ts const&... args)
 }
 
 
-// Emit a note diagnostic using the current buffer to resolve
+// Emit a note diagnostic using the input context to resolve
 // the source code location.
 template<typename... Ts>
 inline void
 note(Location loc, char const* msg, Ts const&... args)
 {
-  note(input_buffer(), loc, msg, args...);
+  note(resolve_input(loc), format(msg, to_string(args)...));
 }
 
 
-// Emit a note diagnostic using the current buffer to resolve
+// Emit a note diagnostic using the input context to resolve
 // the source code location.
 template<typename... Ts>
 inline void
 note(Span span, char const* msg, Ts const&... args)
 {
-  note(input_buffer(), span, msg, args...);
+  note(resolve_input(span), format(msg, to_string(args)...));
 }
 
 
@@ -360,7 +372,7 @@ template<typename... Ts>
 inline void
 note(char const* msg, Ts const&... args)
 {
-  note(input_buffer(), input_location(), msg, args...);
+  note(resolve_input(input_location()), format(msg, to_string(args)...));
 }
 
 
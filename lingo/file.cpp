@@ -2,10 +2,13 @@
 // All rights reserved
 
 #include "file.hpp"
+#include "thread.hpp"
 #include "error.hpp"
 
+#include <cerrno>
 #include <fstream>
-#include <iterator>
+
+#include <sys/stat.h>
 
 namespace lingo
 {
@@ -14,34 +17,118 @@ namespace lingo
 namespace
 {
 
-// Return a string containing the text of the file.
+// Return a string containing the text of the file. The file
+// is read in a single operation.
 String
 read_file(Path const& p)
 {
-  std::ifstream f(p.native());
+  std::ifstream f(p.native(), std::ios::binary);
 
   String text;
   f.seekg(0, std::ios::end);   
-  text.reserve(f.tellg());
+  text.resize(f.tellg());
   f.seekg(0, std::ios::beg);
-
-  std::istreambuf_iterator<char> first = f;
-  std::istreambuf_iterator<char> last;
-  text.assign(first, last);
+  f.read(&text[0], text.size());
+  text.resize(f.gcount());
   
   return text;
 }
 
+
+// Return a buffer holding the text of the file. The file is
+// mapped into memory if possible. Otherwise, its text is read
+// into a string owned by the buffer.
+Buffer
+load_file(Path const& p)
+{
+  Mapped_region map(p.c_str());
+  if (map)
+    return Buffer(std::move(map));
+  else
+    return Buffer(read_file(p));
+}
+
+// Returns the status of the file at `p`. Throws an exception
+// if the file does not exist.
+struct stat
+stat_file(Path const& p)
+{
+  struct stat st;
+  if (::stat(p.c_str(), &st) != 0) {
+    boost::system::error_code err(errno, boost::system::system_category());
+    throw boost::filesystem::filesystem_error("cannot open file", p, err);
+  }
+  return st;
+}
+
+
+// Returns the identity of the file with the given status.
+inline File_id
+get_file_id(struct stat const& st)
+{
+  return {(std::uint64_t)st.st_dev, (std::uint64_t)st.st_ino};
+}
+
+
+// Returns the modification time of the file with the given
+// status, in nanoseconds.
+inline std::int64_t
+get_file_mtime(struct stat const& st)
+{
+  return (std::int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
 } // namespace
 
 
-// Construct file with the given index. This will cache the 
-// text of the file.
-File::File(Path const& p, int n)
-  : Buffer(read_file(p)), path_(p), index_(n)
+// Construct file with the given index, identity, and modification
+// time. This will cache the text of the file.
+File::File(Path const& p, int n, File_id id, std::int64_t t)
+  : Buffer(load_file(p))
+  , path_(p), index_(n), id_(id), mtime_(t)
+  , owner_(nullptr), resident_(true), pins_(0), charge_(0)
 { }
 
 
+// Returns the number of bytes used by the file's text, line
+// map, and line encoding table.
+std::size_t
+File::memory() const
+{
+  return size() + lines_.size() * sizeof(int) + enc_.size();
+}
+
+
+// Reload the file if it has been evicted, since a location in it
+// is being resolved. This is called each time the line map is
+// requested, so it does no LRU bookkeeping, and it never evicts
+// other files, whose text may still be referenced (e.g., by a Line).
+void
+File::acquire() const
+{
+  if (!resident_ && owner_)
+    owner_->reload(*owner_->files_[index_]);
+}
+
+
+// Reload the text of the file.
+void
+File::load()
+{
+  Buffer::operator=(load_file(path_));
+  resident_ = true;
+}
+
+
+// Release the text, line map, and encoding table of the file.
+void
+File::evict()
+{
+  Buffer::operator=(Buffer(String()));
+  resident_ = false;
+}
+
+
 namespace
 {
 
@@ -51,6 +138,11 @@ File_manager fm_;
 } // namespace
 
 
+File_manager::File_manager()
+  : limit_(0), used_(0), stats_ {0, 0, 0}
+{ }
+
+
 // Returns the global file manager.
 File_manager&
 file_manager()
@@ -60,29 +152,197 @@ file_manager()
 
 
 // Open the file at the path indicatd by `p`. If the file has already
-// been opened, then do nothing.
+// been opened, then do nothing. Throws an exception if the file does
+// not exist.
 File&
 File_manager::open(Path const& p)
 {
-  Path real = canonical(p);
-  auto ins = lookup_.insert({p.native(), 0});
-  if (ins.second) {
-    File* file = new File(real, files_.size());
-    files_.push_back(file);
-    ins.first->second = file->index();
-    return *file;
-  } else {
-    int n = ins.first->second;
-    return *files_[n];
+  // If the path has been resolved, return its file.
+  auto iter = paths_.find(p.native());
+  if (iter != paths_.end())
+    return use(iter->second);
+
+  // If the file is being loaded, wait for it.
+  auto load = loads_.find(p.native());
+  if (load != loads_.end()) {
+    std::future<File*> f = std::move(load->second);
+    loads_.erase(load);
+    File& file = insert(f.get());
+    paths_.insert({p.native(), file.index()});
+    return file;
+  }
+
+  // Otherwise, determine the identity of the file and open 
+  // it if it hasn't been seen.
+  struct stat st = stat_file(p);
+  auto id = ids_.find(get_file_id(st));
+  File* file;
+  if (id != ids_.end())
+    file = &use(id->second);
+  else
+    file = &insert(new File(canonical(p), -1, get_file_id(st), get_file_mtime(st)));
+  paths_.insert({p.native(), file->index()});
+  return *file;
+}
+
+
+// Start loading the file at `p` in the background. If `lines` 
+// is true, also build its line map. This does nothing if the path 
+// has been opened or is being loaded.
+void
+File_manager::prefetch(Path const& p, bool lines)
+{
+  if (paths_.count(p.native()) || loads_.count(p.native()))
+    return;
+  auto load = [p, lines]() {
+    struct stat st = stat_file(p);
+    File* file = new File(canonical(p), -1, get_file_id(st), get_file_mtime(st));
+    if (lines)
+      file->lines();
+    return file;
+  };
+  loads_.insert({p.native(), thread_pool().submit(load)});
+}
+
+
+// Add a loaded file to the manager, assigning its index. If a file
+// with the same identity was opened by a different path, the loaded
+// file is discarded and the existing file returned.
+//
+// Loading a new file counts as a miss.
+File&
+File_manager::insert(File* file)
+{
+  auto ins = ids_.insert({file->id(), files_.size()});
+  if (!ins.second) {
+    delete file;
+    return use(ins.first->second);
   }
+  file->index_ = files_.size();
+  file->owner_ = this;
+  files_.push_back(file);
+  lru_.push_front(file->index_);
+  file->lru_ = lru_.begin();
+  ++stats_.misses;
+  charge(*file);
+  trim(file);
+  return *file;
 }
 
 
+// Returns the file with index n, reloading its text if it has
+// been evicted.
 File& 
 File_manager::file(int n)
 {
-  lingo_assert(0 <= n && n << files_.size());
-  return *files_[n];
+  lingo_assert(0 <= n && n < (int)files_.size());
+  return use(n);
+}
+
+
+// Prevent the file from being evicted until it is unpinned. 
+// Pins are counted.
+void
+File_manager::pin(File& file)
+{
+  lingo_assert(file.owner_ == this);
+  touch(file);
+  ++file.pins_;
+}
+
+
+// Allow the file to be evicted the next time a file is opened.
+void
+File_manager::unpin(File& file)
+{
+  lingo_assert(file.owner_ == this && file.pins_ > 0);
+  --file.pins_;
+}
+
+
+// Set the memory limit, evicting files as needed. A limit of
+// 0 means that memory is unlimited.
+void
+File_manager::set_memory_limit(std::size_t n)
+{
+  limit_ = n;
+  trim(nullptr);
+}
+
+
+// Return the nth file for open() or file(), counting a hit if
+// the file is resident. Other files may be evicted.
+File&
+File_manager::use(int n)
+{
+  File& file = *files_[n];
+  if (file.resident_)
+    ++stats_.hits;
+  touch(file);
+  trim(&file);
+  return file;
+}
+
+
+// Move the file to the front of the LRU list. If the file has been
+// evicted, it is reloaded.
+void
+File_manager::touch(File& file)
+{
+  if (file.resident_) {
+    lru_.splice(lru_.begin(), lru_, file.lru_);
+    charge(file);
+  } else {
+    reload(file);
+  }
+}
+
+
+// Reload an evicted file, which counts as a miss. The file is
+// moved to the front of the LRU list. No other file is evicted,
+// so memory may exceed the limit until the next file is opened.
+void
+File_manager::reload(File& file)
+{
+  ++stats_.misses;
+  file.load();
+  lru_.push_front(file.index_);
+  file.lru_ = lru_.begin();
+  charge(file);
+}
+
+
+// Update the memory charged for the file. Note that line maps 
+// are built lazily, so they are charged when the file is next
+// used.
+void
+File_manager::charge(File& file)
+{
+  used_ -= file.charge_;
+  file.charge_ = file.memory();
+  used_ += file.charge_;
+}
+
+
+// Evict least recently used files until memory is within the
+// limit. The file `keep` and pinned files are not evicted.
+void
+File_manager::trim(File const* keep)
+{
+  if (!limit_)
+    return;
+  auto iter = lru_.end();
+  while (used_ > limit_ && iter != lru_.begin()) {
+    --iter;
+    File& file = *files_[*iter];
+    if (&file == keep || file.pins_)
+      continue;
+    used_ -= file.charge_;
+    file.charge_ = 0;
+    file.evict();
+    ++stats_.evictions;
+    iter = lru_.erase(iter);
+  }
 }
 
 
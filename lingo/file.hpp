@@ -8,7 +8,11 @@
 // files and their text.
 
 #include "lingo/buffer.hpp"
+#include "lingo/token.hpp"
 
+#include <cstdint>
+#include <future>
+#include <list>
 #include <unordered_map>
 #include <vector>
 
@@ -28,6 +32,36 @@ namespace lingo
 using Path = boost::filesystem::path;
 
 
+class File_manager;
+
+
+// A file identity is the device and inode of a file. Different
+// paths to the same file have the same identity.
+struct File_id
+{
+  std::uint64_t dev;
+  std::uint64_t ino;
+};
+
+
+inline bool
+operator==(File_id a, File_id b)
+{
+  return a.dev == b.dev && a.ino == b.ino;
+}
+
+
+// Hash a file identity.
+struct File_id_hash
+{
+  std::size_t
+  operator()(File_id id) const
+  {
+    return std::hash<std::uint64_t>()(id.dev * 31 + id.ino);
+  }
+};
+
+
 // Represents a file system file. This object is primary used
 // to house the text the file contains, providing long-term
 // storage for its text.
@@ -35,22 +69,52 @@ using Path = boost::filesystem::path;
 // A file also includes a line map, which is used to associate
 // file information with lines.
 //
+// The text and line map of a file may be evicted by its file
+// manager when another file is opened. The text is reloaded the
+// next time a location in the file is resolved. Note that the
+// text is assumed not to change on disk while the file is open.
+//
 // TODO: Use std::filesystem when it becomes standard.
 class File : public Buffer
 {
   friend class File_manager;
 
-  File(Path const&, int);
+  File(Path const&, int, File_id, std::int64_t);
+
+  void acquire() const override;
 
 public:
   // Observers
   Path const& path() const { return path_; }
   
-  int index() const { return index_; }
+  int     index() const { return index_; }
+  File_id id() const    { return id_; }
+
+  // Returns the modification time of the file when it was
+  // opened, in nanoseconds.
+  std::int64_t mtime() const { return mtime_; }
+
+  // Returns true if the text of the file is in memory.
+  bool is_resident() const { return resident_; }
+
+  // Returns the number of bytes used by the text and line map.
+  std::size_t memory() const;
 
 private:
-  Path        path_;
-  int         index_;
+  void load();
+  void evict();
+
+  Path         path_;
+  int          index_;
+  File_id      id_;
+  std::int64_t mtime_;
+
+  // Memory management
+  File_manager*            owner_;
+  bool                     resident_;
+  int                      pins_;   // Prevents eviction if non-zero
+  std::size_t              charge_; // Memory charged to the owner
+  std::list<int>::iterator lru_;    // Position in the owner's LRU list
 };
 
 
@@ -60,21 +124,121 @@ private:
 // The file manager provides a facility for globally managing
 // opened files. This effectively a list of opened (note: not
 // open) files and a side-table for efficient path-based lookup.
+//
+// Files are identified by their device and inode, so different
+// paths to the same file (e.g., `a/../b.x` and `b.x`) open the
+// same file. The identity of each path is resolved once and
+// cached; reopening a path makes no system calls. Paths are
+// canonicalized only when a new file is opened.
+//
+// Files can be prefetched. Prefetching a file loads its text (and
+// optionally builds its line map) on the global thread pool. A
+// later call to open() for that path waits until the file has been
+// loaded, if it hasn't been already. Errors that occur while loading
+// a prefetched file are reported by open(). Note that the file 
+// manager must only be used by a single thread.
+//
+// The file manager can be given a memory limit. When the text and
+// line maps of open files exceed that limit, the least recently used
+// files are evicted: their text is unmapped (or freed) and their
+// line maps are discarded. A file is used when it is returned by
+// open() or file(). Files are only evicted by those calls and by
+// set_memory_limit(). Resolving a location in an evicted file reloads
+// it without evicting others, so lines and string views taken from
+// files remain valid until the next file is opened. Files can be
+// pinned to keep them resident across opens, e.g., while they are
+// being lexed. File indexes are never reused. Memory is unlimited
+// by default.
+//
+// The file manager can also keep a persistent, on-disk cache of the
+// tokens lexed from files, so that files that have not changed
+// between runs are not lexed again (see tokens()). The cache is
+// disabled by default. When enabled, each file has an entry in the
+// cache directory. An entry records the file's size and a hash of
+// its contents, the version of the installed token set (see
+// token_set_version), and the tokens of the file. A token is stored
+// as its offset from the start of the file and the index of its
+// spelling in a table of spellings. Spellings are re-interned in the
+// symbol table when the entry is loaded. An entry is used only if the
+// token set version, file size, and hash of the file's contents match.
 class File_manager
 {
 public:
+  // Usage counts. A hit is a call to open() or file() that returns
+  // a resident file, and a miss is the loading or reloading of a
+  // file. Resolving locations in a resident file is not counted.
+  struct Stats
+  {
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+  };
+
+  File_manager();
+
   File& open(char const*);
   File& open(std::string const&);
   File& open(Path const&);
 
+  template<typename I>
+  std::vector<File*> open(I, I);
+
+  void prefetch(Path const&, bool = false);
+
+  template<typename I>
+  void prefetch(I, I, bool = false);
+
   File& file(int);
 
+  void pin(File&);
+  void unpin(File&);
+
+  void        set_memory_limit(std::size_t);
+  std::size_t memory_limit() const { return limit_; }
+  std::size_t memory() const       { return used_; }
+
+  Stats const& stats() const { return stats_; }
+
+  void        set_token_cache(Path const&);
+  void        disable_token_cache();
+  Path const& token_cache() const { return cache_; }
+
+  template<typename Lex>
+  void tokens(File&, Token_list&, Lex, Location = Location(0));
+
 private:
+  friend class File;
+
+  File& insert(File*);
+  File& use(int);
+  void  touch(File&);
+  void  reload(File&);
+  void  charge(File&);
+  void  trim(File const*);
+
+  bool  read_tokens(File const&, Location, Token_list&) const;
+  void  write_tokens(File const&, Location, Token const*, Token const*) const;
+
   using File_list = std::vector<File*>;
-  using File_map  = std::unordered_map<std::string, int>;
+  using Path_map  = std::unordered_map<std::string, int>;
+  using Id_map    = std::unordered_map<File_id, int, File_id_hash>;
+  using Load_map  = std::unordered_map<std::string, std::future<File*>>;
+  using Lru_list  = std::list<int>;
 
   File_list files_;
-  File_map  lookup_;
+  Path_map  paths_;
+  Id_map    ids_;
+  Load_map  loads_;
+
+  // Memory management. The LRU list holds the indexes of resident
+  // files, most recently used first.
+  Lru_list    lru_;
+  std::size_t limit_;
+  std::size_t used_;
+  Stats       stats_;
+
+  // The token cache directory. The cache is disabled when empty.
+  Path cache_;
 };
 
 
@@ -94,6 +258,47 @@ File_manager::open(std::string const& p)
 }
 
 
+// Open each file in the range of paths [first, last), returning
+// the opened files in order.
+template<typename I>
+std::vector<File*>
+File_manager::open(I first, I last)
+{
+  std::vector<File*> files;
+  for (; first != last; ++first)
+    files.push_back(&open(*first));
+  return files;
+}
+
+
+// Prefetch each file in the range of paths [first, last). If
+// `lines` is true, the line map of each file is also built.
+template<typename I>
+void
+File_manager::prefetch(I first, I last, bool lines)
+{
+  for (; first != last; ++first)
+    prefetch(*first, lines);
+}
+
+
+// Append the tokens of `file` to `toks`. If the token cache has a
+// valid entry for the file, its tokens are used. Otherwise, the file
+// is lexed by calling `lex(file, toks)`, and the tokens that it
+// appends are saved in the cache. The locations of the tokens start
+// at `start`, e.g., the base location of the file in a source manager.
+template<typename Lex>
+void
+File_manager::tokens(File& file, Token_list& toks, Lex lex, Location start)
+{
+  if (read_tokens(file, start, toks))
+    return;
+  std::size_t n = toks.size();
+  lex(file, toks);
+  write_tokens(file, start, toks.data() + n, toks.data() + toks.size());
+}
+
+
 File_manager& file_manager();
 
 
@@ -20,8 +20,8 @@ std::size_t
 String_hash::operator()(String const* p) const
 {
   assert(p);
-  std::hash<std::string> h;
-  return h(p->value());
+  std::string const& s = p->value();
+  return hash_bytes(s.data(), s.data() + s.size());
 }
 
 
@@ -10,6 +10,9 @@
 //
 // These algorithms are based on a Lexer concept. Every
 // lexer must expose a number of operations.
+//
+// The source locations passed to a lexer's operations have
+// the location type of the character stream (see Location_type).
 
 #include "lingo/string.hpp"
 #include "lingo/location.hpp"
@@ -102,7 +105,7 @@ is_identifier_rest(char c)
 // is `s` must be in the set of decimal digits.
 template<typename Lexer, typename Stream>
 inline Result_type<Lexer>
-lex_decimal_integer(Lexer& lex, Stream& s, Location loc)
+lex_decimal_integer(Lexer& lex, Stream& s, Location_type<Stream> loc)
 {
   auto pred = [](Stream& s) { return next_element_if(s, is_decimal_digit); };
   auto range = match_range_after_first(s, pred);
@@ -135,7 +138,7 @@ match_integer_in_base(Stream& s, P pred)
 // known to be '0b' or '0B'
 template<typename Lexer, typename Stream>
 inline Result_type<Lexer>
-lex_binary_integer(Lexer& lex, Stream& s, Location loc)
+lex_binary_integer(Lexer& lex, Stream& s, Location_type<Stream> loc)
 {
   auto pred = [](Stream& s) { return next_element_if(s, is_binary_digit); };
   auto range = match_integer_in_base(s, pred);
@@ -151,7 +154,7 @@ lex_binary_integer(Lexer& lex, Stream& s, Location loc)
 // known to be '0o' or '0O' (that's a 0 and an O).
 template<typename Lexer, typename Stream>
 inline Result_type<Lexer>
-lex_octal_integer(Lexer& lex, Stream& s, Location loc)
+lex_octal_integer(Lexer& lex, Stream& s, Location_type<Stream> loc)
 {
   auto pred = [](Stream& s) { return next_element_if(s, is_octal_digit); };
   auto range = match_integer_in_base(s, pred);
@@ -167,7 +170,7 @@ lex_octal_integer(Lexer& lex, Stream& s, Location loc)
 // known to be '0x' or '0X'.
 template<typename Lexer, typename Stream>
 inline Result_type<Lexer>
-lex_hexadecimal_integer(Lexer& lex, Stream& s, Location loc)
+lex_hexadecimal_integer(Lexer& lex, Stream& s, Location_type<Stream> loc)
 {
   auto pred = [](Stream& s) { return next_element_if(s, is_hexadecimal_digit); };
   auto range = match_integer_in_base(s, pred);
@@ -190,7 +193,7 @@ lex_hexadecimal_integer(Lexer& lex, Stream& s, Location loc)
 // TODO: Add support for floating point values.
 template<typename Lexer, typename Stream>
 inline Result_type<Lexer>
-lex_number(Lexer& l, Stream& s, Location loc)
+lex_number(Lexer& l, Stream& s, Location_type<Stream> loc)
 {
   if (s.peek() == '0') {
     if (nth_element_is(s, 1, 'b'))
@@ -205,10 +208,10 @@ lex_number(Lexer& l, Stream& s, Location loc)
 
 template<typename Lexer, typename Stream>
 inline Result_type<Lexer>
-lex_identifier(Lexer& l, Stream& s, Location loc)
+lex_identifier(Lexer& l, Stream& s, Location_type<Stream> loc)
 {
   auto first = s.begin();
-  while (!s.eof() && is_identifier_rest(s.peek()))
+  while (next_element_if(s, is_identifier_rest))
     s.get();
   return l.on_identifier(loc, first, s.begin());
 }
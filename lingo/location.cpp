@@ -35,7 +35,7 @@ Bound_location::file() const
 
 
 // Return the line of text represented by this location.
-Line const&
+Line
 Bound_location::line() const
 {
   return buf_->line(loc_);
@@ -76,7 +76,7 @@ Bound_span::file() const
 
 
 // Return the first line of text in the span.
-Line const&
+Line
 Bound_span::line() const
 {
   return buf_->line(span_.start());
@@ -7,6 +7,7 @@
 // The location module provides facilities for representing
 // locations in source code.
 
+#include <cstdint>
 #include <iosfwd>
 
 namespace lingo
@@ -50,6 +51,36 @@ private:
 };
 
 
+// A wide location is the offset of a character in an input
+// that is not held in a buffer (e.g., a file character stream).
+// Wide locations are 64 bits, so they can refer to characters in
+// inputs larger than 2GB.
+//
+// Wide locations cannot be resolved to lines or columns.
+class Wide_location
+{
+public:
+  Wide_location()
+    : loc_(-1)
+  { }
+
+  explicit Wide_location(std::int64_t n)
+    : loc_(n)
+  { }
+
+  // Returns the offset into the input.
+  std::int64_t offset() const { return loc_; }
+
+  explicit operator bool() const { return loc_ != -1; }
+
+  bool operator==(Wide_location l) const { return loc_ == l.loc_; }
+  bool operator!=(Wide_location l) const { return loc_ != l.loc_; }
+
+private:
+  std::int64_t loc_;
+};
+
+
 // A span of text is represented by a pair of source 
 // locations. Like a location, a text span must be
 // resolved against its input buffer.
@@ -81,6 +112,12 @@ struct Span
 // FIXME: Don't call this "bound"
 struct Bound_location
 {
+  // Construct an unbound location. This is used for diagnostics
+  // that do not refer to text in a buffer.
+  Bound_location()
+    : buf_(nullptr), loc_()
+  { }
+
   Bound_location(Buffer const& b, Location l)
     : buf_(&b), loc_(l)
   { }
@@ -90,7 +127,7 @@ struct Bound_location
 
   Buffer const& buffer() const { return *buf_; }
   File const& file() const;
-  Line const& line() const;
+  Line line() const;
   
   int line_no() const;
   int column_no() const;
@@ -116,7 +153,7 @@ struct Bound_span
 
   Buffer const& buffer() const { return *buf_; }
   File const& file() const;
-  Line const& line() const;
+  Line line() const;
   
   int start_line_no() const;
   int end_line_no() const;
@@ -7,6 +7,44 @@
 namespace lingo
 {
 
+// -------------------------------------------------------------------------- //
+//                                Arenas
+
+Arena::Arena(std::size_t n)
+  : page_(n), first_(nullptr), last_(nullptr), bytes_(0)
+{ }
+
+
+Arena::~Arena()
+{
+  for (char* p : pages_)
+    delete [] p;
+}
+
+
+// Allocate `n` bytes aligned to `a` from a new page or block.
+void*
+Arena::grow(std::size_t n, std::size_t a)
+{
+  std::size_t size = n + a - 1;
+  if (size > page_ / 4) {
+    char* block = new char[size];
+    pages_.push_back(block);
+    bytes_ += size;
+    std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(block) + a - 1) & ~(a - 1);
+    return reinterpret_cast<void*>(p);
+  }
+  first_ = new char[page_];
+  last_ = first_ + page_;
+  pages_.push_back(first_);
+  bytes_ += page_;
+  return allocate(n, a);
+}
+
+
+// -------------------------------------------------------------------------- //
+//                          Garbage collector
+
 namespace
 {
 
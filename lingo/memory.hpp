@@ -6,6 +6,8 @@
 
 #include "lingo/node.hpp"
 
+#include <cstddef>
+#include <cstdint>
 #include <list>
 #include <set>
 #include <unordered_map>
@@ -61,6 +63,55 @@ struct Singleton_factory
 };
 
 
+// -------------------------------------------------------------------------- //
+//                                Arenas
+
+// An arena is a bump allocator. Memory is allocated from large
+// pages by advancing a pointer, and all of the pages are freed
+// when the arena is destroyed. Individual objects are never freed
+// and their destructors are not run, so an arena should only hold
+// trivially destructible objects.
+//
+// Requests larger than a quarter of a page are given their own
+// block, so that little of the current page is wasted.
+class Arena
+{
+public:
+  explicit Arena(std::size_t = 1 << 16);
+  ~Arena();
+
+  Arena(Arena const&) = delete;
+  Arena& operator=(Arena const&) = delete;
+
+  void* allocate(std::size_t, std::size_t = alignof(std::max_align_t));
+
+  // Returns the number of bytes obtained from the system.
+  std::size_t capacity() const { return bytes_; }
+
+private:
+  void* grow(std::size_t, std::size_t);
+
+  std::size_t        page_;  // The size of a page
+  char*              first_; // The next free byte in the current page
+  char*              last_;  // Past the end of the current page
+  std::vector<char*> pages_; // All pages and large blocks
+  std::size_t        bytes_;
+};
+
+
+// Allocate `n` bytes aligned to `a`, which must be a power of 2.
+inline void*
+Arena::allocate(std::size_t n, std::size_t a)
+{
+  std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(first_) + a - 1) & ~(a - 1);
+  if (p + n <= reinterpret_cast<std::uintptr_t>(last_)) {
+    first_ = reinterpret_cast<char*>(p + n);
+    return first_ - n;
+  }
+  return grow(n, a);
+}
+
+
 // -------------------------------------------------------------------------- //
 //                          Garbage collector
 
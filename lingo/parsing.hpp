@@ -94,7 +94,7 @@ next_token_kind(Stream& s)
   if (s.eof())
     return {};
   else
-    return s.peek().kind();
+    return s.peek_kind();
 }
 
 
@@ -148,7 +148,9 @@ template<typename Stream>
 inline Iterator_type<Stream>
 match_token(Stream& s, int k)
 {
-  return match_if(s, is_token(k));
+  if (!s.eof() && s.peek_kind() == k)
+    return &s.get();
+  return nullptr;
 }
 
 
@@ -0,0 +1,101 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#include "lingo/scope.hpp"
+#include "lingo/error.hpp"
+
+namespace lingo
+{
+
+// -------------------------------------------------------------------------- //
+//                              Scope stacks
+
+Scope_stack::Scope_stack()
+  : free_(nullptr), arena_(1 << 12)
+{ }
+
+
+// Pop any remaining scopes so that no symbol refers to a binding
+// in the arena.
+Scope_stack::~Scope_stack()
+{
+  while (!scopes_.empty())
+    pop();
+}
+
+
+// Enter a new scope.
+void
+Scope_stack::push()
+{
+  scopes_.push_back(nullptr);
+}
+
+
+// Leave the innermost scope. Each of its bindings is removed from
+// its symbol's chain, latest first, so the bindings it hid are
+// restored.
+void
+Scope_stack::pop()
+{
+  lingo_assert(!scopes_.empty());
+  Binding* b = scopes_.back();
+  while (b) {
+    Binding* prev = b->prev;
+    b->sym->binding = b->hidden;
+    b->prev = free_;
+    free_ = b;
+    b = prev;
+  }
+  scopes_.pop_back();
+}
+
+
+// Bind `sym` to `x` in the innermost scope, hiding any previous
+// binding of the symbol. There must be an open scope.
+Binding&
+Scope_stack::bind(Symbol const& sym, void* x)
+{
+  lingo_assert(!scopes_.empty());
+  Binding* b = free_;
+  if (b)
+    free_ = b->prev;
+  else
+    b = static_cast<Binding*>(arena_.allocate(sizeof(Binding), alignof(Binding)));
+  *b = {&sym, x, sym.binding, scopes_.back(), depth()};
+  sym.binding = b;
+  scopes_.back() = b;
+  return *b;
+}
+
+
+// -------------------------------------------------------------------------- //
+//                              Scope interface
+
+// Returns the global scope stack. It is never destroyed, since the
+// symbols it binds may be destroyed before it.
+Scope_stack&
+scopes()
+{
+  static Scope_stack* s = new Scope_stack();
+  return *s;
+}
+
+
+// Enter a new scope.
+void
+push_scope()
+{
+  scopes().push();
+}
+
+
+// Leave the innermost scope, removing its bindings.
+void
+pop_scope()
+{
+  scopes().pop();
+}
+
+
+} // namespace lingo
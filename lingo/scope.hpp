@@ -0,0 +1,149 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#ifndef LINGO_SCOPE_HPP
+#define LINGO_SCOPE_HPP
+
+// The scope module provides a stack of scopes that bind symbols
+// to declarations (or any other information). Each symbol refers
+// to its innermost binding, so name lookup does not search the
+// scopes.
+
+#include "lingo/symbol.hpp"
+#include "lingo/memory.hpp"
+
+#include <vector>
+
+namespace lingo
+{
+
+// -------------------------------------------------------------------------- //
+//                                Bindings
+
+// A binding associates a symbol with a value in some scope. The
+// bindings of a symbol form a chain from the innermost binding
+// (see Symbol::binding) through the bindings it hides. The bindings
+// of a scope form a second chain, from the most recent binding in
+// the scope to the first.
+struct Binding
+{
+  Symbol const* sym;    // The bound symbol
+  void*         value;  // The bound value
+  Binding*      hidden; // The binding hidden by this one
+  Binding*      prev;   // The previous binding in the same scope
+  int           depth;  // The depth of the binding's scope
+};
+
+
+// -------------------------------------------------------------------------- //
+//                              Scope stacks
+
+// A scope stack maintains the bindings of nested scopes. Binding a
+// symbol pushes a new binding onto the symbol's chain, hiding any
+// previous binding. Popping a scope removes its bindings in the
+// reverse order in which they were made, restoring the bindings
+// that they hid. Finding the innermost binding of a symbol loads
+// a single pointer, and popping a scope takes time proportional
+// to the number of bindings in that scope.
+//
+// Because bindings are stored in symbols, only one scope stack
+// should be in use at a time for a given symbol table. Scope
+// stacks are not thread safe.
+//
+// Bindings are allocated from an arena and reused after their
+// scope is popped.
+class Scope_stack
+{
+public:
+  Scope_stack();
+  ~Scope_stack();
+
+  Scope_stack(Scope_stack const&) = delete;
+  Scope_stack& operator=(Scope_stack const&) = delete;
+
+  void push();
+  void pop();
+
+  // Returns the number of open scopes.
+  int depth() const { return scopes_.size(); }
+
+  Binding& bind(Symbol const&, void*);
+
+  // Returns the innermost binding of a symbol, or nullptr
+  // if the symbol is not bound.
+  Binding* lookup(Symbol const& sym) const { return sym.binding; }
+
+  Binding* lookup_local(Symbol const&) const;
+
+private:
+  std::vector<Binding*> scopes_; // The last binding in each scope
+  Binding*              free_;   // Bindings available for reuse
+  Arena                 arena_;
+};
+
+
+// Returns the innermost binding of `sym` if it is in the
+// innermost scope, or nullptr if not. This is used to detect
+// redeclarations.
+inline Binding*
+Scope_stack::lookup_local(Symbol const& sym) const
+{
+  Binding* b = sym.binding;
+  return b && b->depth == depth() ? b : nullptr;
+}
+
+
+// -------------------------------------------------------------------------- //
+//                              Scope interface
+
+Scope_stack& scopes();
+
+void push_scope();
+void pop_scope();
+
+
+// Bind `sym` to `x` in the innermost scope.
+template<typename T>
+inline void
+bind(Symbol const& sym, T* x)
+{
+  scopes().bind(sym, x);
+}
+
+
+// Returns the value of the innermost binding of `sym` or
+// nullptr if it is unbound.
+template<typename T>
+inline T*
+lookup_binding(Symbol const& sym)
+{
+  return sym.binding ? static_cast<T*>(sym.binding->value) : nullptr;
+}
+
+
+// Returns the value of the binding of `sym` in the innermost
+// scope or nullptr if it is not bound there.
+template<typename T>
+inline T*
+lookup_local_binding(Symbol const& sym)
+{
+  Binding* b = scopes().lookup_local(sym);
+  return b ? static_cast<T*>(b->value) : nullptr;
+}
+
+
+// An RAII helper that pushes a scope on construction and pops
+// it on destruction.
+struct Enter_scope
+{
+  Enter_scope()  { push_scope(); }
+  ~Enter_scope() { pop_scope(); }
+
+  Enter_scope(Enter_scope const&) = delete;
+  Enter_scope& operator=(Enter_scope const&) = delete;
+};
+
+
+} // namespace lingo
+
+#endif
@@ -0,0 +1,167 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#include "source.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace lingo
+{
+
+Source_manager::Source_manager()
+  : next_(0)
+{ }
+
+
+// Add a buffer to the source manager, returning its base
+// location. The buffer must not already have been added.
+Location
+Source_manager::add(Buffer const& buf)
+{
+  std::size_t n = buf.size();
+  lingo_alert(n < std::size_t(std::numeric_limits<int>::max() - next_),
+              "source location space exhausted");
+  int base = next_;
+  bases_.push_back(base);
+  bufs_.push_back(&buf);
+  next_ += n + 1;
+  return Location(base);
+}
+
+
+// Returns the index of the buffer containing the given location.
+int
+Source_manager::index(Location loc) const
+{
+  lingo_assert(loc && loc.offset() < next_);
+  int const  off = loc.offset();
+  int const* base = bases_.data();
+  int        n = bases_.size();
+  while (n > 1) {
+    int half = n / 2;
+    base = (base[half] <= off) ? base + half : base;
+    n -= half;
+  }
+  return base - bases_.data();
+}
+
+
+// Resolve a source location to its buffer and offset.
+Bound_location
+Source_manager::location(Location loc) const
+{
+  int n = index(loc);
+  return {*bufs_[n], Location(loc.offset() - bases_[n])};
+}
+
+
+// Resolve a source span. Both ends of the span must be in the
+// same buffer.
+Bound_span
+Source_manager::span(Span s) const
+{
+  int n = index(s.start());
+  Location start(s.start().offset() - bases_[n]);
+  Location end(s.end().offset() - bases_[n]);
+  return {*bufs_[n], Span(start, end)};
+}
+
+
+// Resolve the line and column numbers of each source location
+// in [first, last), storing them in the corresponding element of
+// `out`. The locations are sorted and then resolved in one pass
+// over the buffers, one line map traversal per buffer. Invalid
+// locations resolve to line and column 0.
+void
+Source_manager::resolve_all(Location const* first, Location const* last, Position* out) const
+{
+  std::vector<int> order(last - first);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [first](int a, int b) {
+    return first[a].offset() < first[b].offset();
+  });
+
+  std::vector<Location> locs;
+  std::vector<Position> pos;
+  auto iter = order.begin();
+  while (iter != order.end()) {
+    Location loc = first[*iter];
+    if (!loc) {
+      out[*iter++] = {0, 0};
+      continue;
+    }
+
+    // Gather the locations in this buffer.
+    int n = index(loc);
+    int end = n + 1 < size() ? bases_[n + 1] : next_;
+    auto run = iter;
+    locs.clear();
+    for (; iter != order.end() && first[*iter].offset() < end; ++iter)
+      locs.push_back(Location(first[*iter].offset() - bases_[n]));
+
+    pos.resize(locs.size());
+    bufs_[n]->resolve_all(locs.data(), locs.data() + locs.size(), pos.data());
+    for (Position p : pos)
+      out[*run++] = p;
+  }
+}
+
+
+// Returns the line and column numbers of each source location.
+std::vector<Position>
+Source_manager::resolve_all(std::vector<Location> const& locs) const
+{
+  std::vector<Position> pos(locs.size());
+  resolve_all(locs.data(), locs.data() + locs.size(), pos.data());
+  return pos;
+}
+
+
+// -------------------------------------------------------------------------- //
+//                             Input context
+
+
+// Resolve an input location. If the input context was established
+// with a source manager, the location is a source location.
+// Otherwise, it is an offset in the input buffer.
+Bound_location
+resolve_input(Location loc)
+{
+  Source_manager const* sm = input_source_manager();
+  if (sm && loc)
+    return sm->location(loc);
+  return input_buffer().location(loc);
+}
+
+
+// Resolve an input span.
+Bound_span
+resolve_input(Span span)
+{
+  Source_manager const* sm = input_source_manager();
+  if (sm && span)
+    return sm->span(span);
+  return input_buffer().span(span);
+}
+
+
+namespace
+{
+
+// The global source manager.
+Source_manager sm_;
+
+} // namespace
+
+
+// Returns the global source manager.
+Source_manager&
+source_manager()
+{
+  return sm_;
+}
+
+
+} // namespace lingo
@@ -0,0 +1,142 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#ifndef LINGO_SOURCE_HPP
+#define LINGO_SOURCE_HPP
+
+// The source module provides a single location space for all
+// of the buffers in a program.
+
+#include "lingo/buffer.hpp"
+#include "lingo/error.hpp"
+
+#include <vector>
+
+namespace lingo
+{
+
+// -------------------------------------------------------------------------- //
+//                            Source manager
+
+// The source manager assigns each buffer a disjoint range of
+// locations. A buffer of n characters added at base b owns the
+// locations [b, b + n]; the last of these is the end of the buffer.
+// A location in this space (a source location) identifies both its
+// buffer and its offset within that buffer, so it can be resolved
+// without a separate buffer. Resolution is a binary search over the
+// base locations of the buffers.
+//
+// To lex a buffer using source locations, construct its character
+// stream with the buffer's base location (see Character_stream), and
+// establish the input context with the source manager so that
+// diagnostics resolve those locations:
+//
+//    Input_context cxt(buf, source_manager());
+//    Character_stream cs(buf, base);
+//
+// Locations are 32 bits, so the total size of all buffers is
+// limited to 2GB. Buffers must outlive the source manager, and
+// they are never removed.
+//
+// Finding the buffer of a location is thread safe, provided that
+// no buffers are being added. Resolving a line or column is not
+// thread safe, since it may build the buffer's line map and cache
+// the ASCII-ness of its lines (see Buffer). Resolve locations from
+// one thread, or resolve each buffer once before sharing it.
+class Source_manager
+{
+public:
+  Source_manager();
+
+  Location add(Buffer const&);
+
+  // Observers
+  int size() const { return bufs_.size(); }
+
+  Buffer const& buffer(int n) const { return *bufs_[n]; }
+  Location      base(int n) const   { return Location(bases_[n]); }
+
+  int           index(Location) const;
+  Buffer const& buffer(Location loc) const { return *bufs_[index(loc)]; }
+  Location      local(Location) const;
+
+  // Resolution
+  Bound_location location(Location) const;
+  Bound_span     span(Span) const;
+
+  void                  resolve_all(Location const*, Location const*, Position*) const;
+  std::vector<Position> resolve_all(std::vector<Location> const&) const;
+
+private:
+  std::vector<int>           bases_;
+  std::vector<Buffer const*> bufs_;
+  int                        next_;
+};
+
+
+// Returns the offset of `loc` within its buffer.
+inline Location
+Source_manager::local(Location loc) const
+{
+  return Location(loc.offset() - bases_[index(loc)]);
+}
+
+
+Source_manager& source_manager();
+
+
+// Resolve a source location. This is used internally. Do not call.
+inline Bound_location
+resolve(Source_manager const& sm, Location loc)
+{
+  return sm.location(loc);
+}
+
+
+// Resolve a source span. This is used internally. Do not call.
+inline Bound_span
+resolve(Source_manager const& sm, Span span)
+{
+  return sm.span(span);
+}
+
+
+// -------------------------------------------------------------------------- //
+//                             Diagnostics
+//
+// Diagnostics can be emitted at source locations by giving the
+// source manager in place of the buffer:
+//
+//    error(source_manager(), loc, str, args...)
+
+
+// Emit an error diagnostic at a source location or span.
+template<typename Caret, typename... Ts>
+inline void
+error(Source_manager const& sm, Caret caret, char const* msg, Ts const&... args)
+{
+  error(resolve(sm, caret), format(msg, to_string(args)...));
+}
+
+
+// Emit a warning diagnostic at a source location or span.
+template<typename Caret, typename... Ts>
+inline void
+warning(Source_manager const& sm, Caret caret, char const* msg, Ts const&... args)
+{
+  warning(resolve(sm, caret), format(msg, to_string(args)...));
+}
+
+
+// Emit a note at a source location or span.
+template<typename Caret, typename... Ts>
+inline void
+note(Source_manager const& sm, Caret caret, char const* msg, Ts const&... args)
+{
+  note(resolve(sm, caret), format(msg, to_string(args)...));
+}
+
+
+} // namespace lingo
+
+#endif
@@ -5,9 +5,244 @@
 
 #include <iostream>
 
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 namespace lingo
 {
 
+// -------------------------------------------------------------------------- //
+//                              Hashing
+//
+// Strings are hashed a word at a time. Strings of up to 16 characters
+// are read as two (possibly overlapping) words, which are combined with
+// a 64x64 to 128-bit multiply whose high and low halves are folded
+// together (as in wyhash). Longer strings are consumed 16 characters
+// per multiply, so every character affects the result.
+//
+// Strings of 256 or more characters are consumed in 64 character
+// stripes by 8 independent accumulators, as in xxh3. The stripe loop
+// is vectorized with SSE2 or AVX2 where available; the scalar loop
+// computes the same result.
+
+namespace
+{
+
+constexpr std::uint64_t p0_ = 0xa0761d6478bd642full;
+constexpr std::uint64_t p1_ = 0xe7037ed1a0b428dbull;
+constexpr std::uint64_t p2_ = 0x8ebc6af09c88c6e3ull;
+constexpr std::uint64_t p3_ = 0x589965cc75374cc3ull;
+
+
+// Keys for the accumulators of the stripe loop. The nth stripe of
+// a block uses the 8 keys starting at the nth.
+constexpr std::uint64_t stripe_key_[24] = {
+  0x2cb0f69f4abea221ull, 0x9417034723148989ull,
+  0xdd555950609dfe03ull, 0xdbafb150deb12800ull,
+  0x7e789b2e6c442cb6ull, 0xf41e5636c7e4f8c4ull,
+  0x0959d150f8fba7e4ull, 0xa97316f13cdb9eeaull,
+  0x74cd8258f9520068ull, 0x55c74a62e116868bull,
+  0xd2f4c799a2023cbdull, 0xdf98cb79a37b51b9ull,
+  0x396f5885524f3905ull, 0xaf1d56386ca3b276ull,
+  0xa9ffbe6b5104e85aull, 0x6bd0c51b9fd533b3ull,
+  0x980ce91c50ab4b56ull, 0x28ac395780fe62c5ull,
+  0x768912e3a6bcedc7ull, 0x50b3e8c9332c7c88ull,
+  0xce3bbfe520bd47daull, 0xcba6c8e8e0bb7c4full,
+  0xbf194db8434a346dull, 0x7d8f2a7b60416d7full,
+};
+
+
+// Keys used to scramble the accumulators.
+constexpr std::uint64_t scramble_key_[8] = {
+  0xcb00c391bb52283cull, 0xa32e531b8b65d088ull,
+  0x4ef90da297486471ull, 0xd8acdea946ef1938ull,
+  0x3f349ce33f76faa8ull, 0x1d4f0bc7c7bbdcf9ull,
+  0x3159b4cd4be0518aull, 0x647378d9c97e9fc8ull,
+};
+
+
+// Accumulators are scrambled after this many stripes.
+constexpr int stripes_per_block_ = 16;
+
+
+inline std::uint64_t
+read64(char const* p)
+{
+  std::uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+
+inline std::uint64_t
+read32(char const* p)
+{
+  std::uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+
+// Multiply `a` and `b`, returning the exclusive or of the high and
+// low 64 bits of the product.
+inline std::uint64_t
+mix(std::uint64_t a, std::uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128)a * b;
+  return std::uint64_t(r) ^ std::uint64_t(r >> 64);
+#else
+  std::uint64_t ha = a >> 32, hb = b >> 32, la = std::uint32_t(a), lb = std::uint32_t(b);
+  std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  std::uint64_t t = rl + (rm0 << 32);
+  std::uint64_t c = t < rl;
+  std::uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  std::uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  return lo ^ hi;
+#endif
+}
+
+
+// Hash strings of fewer than 256 characters.
+std::uint64_t
+hash_short(char const* p, std::size_t n, std::uint64_t seed)
+{
+  seed ^= mix(seed ^ p0_, p1_);
+  std::uint64_t a;
+  std::uint64_t b;
+  if (n <= 16) {
+    if (n >= 4) {
+      std::size_t k = (n >> 3) << 2;
+      a = (read32(p) << 32) | read32(p + k);
+      b = (read32(p + n - 4) << 32) | read32(p + n - 4 - k);
+    } else if (n > 0) {
+      a = (std::uint64_t((unsigned char)p[0]) << 16) 
+        | (std::uint64_t((unsigned char)p[n >> 1]) << 8) 
+        | (unsigned char)p[n - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    std::size_t i = n;
+    if (i > 48) {
+      std::uint64_t s1 = seed;
+      std::uint64_t s2 = seed;
+      do {
+        seed = mix(read64(p) ^ p1_, read64(p + 8) ^ seed);
+        s1 = mix(read64(p + 16) ^ p2_, read64(p + 24) ^ s1);
+        s2 = mix(read64(p + 32) ^ p3_, read64(p + 40) ^ s2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= s1 ^ s2;
+    }
+    while (i > 16) {
+      seed = mix(read64(p) ^ p1_, read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = read64(p + i - 16);
+    b = read64(p + i - 8);
+  }
+  return mix(p1_ ^ n, mix(a ^ p1_, b ^ seed));
+}
+
+
+// Accumulate the 64 characters at `p` into `acc`, using the keys
+// starting at `key`. For each lane, the product of the high and low
+// halves of the keyed input is added to the lane, and the input is
+// added to the adjacent lane.
+inline void
+accumulate(std::uint64_t* acc, char const* p, std::uint64_t const* key)
+{
+#if defined(__AVX2__)
+  __m256i* a = reinterpret_cast<__m256i*>(acc);
+  for (int i = 0; i != 2; ++i) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p) + i);
+    __m256i k = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(key) + i);
+    __m256i dk = _mm256_xor_si256(d, k);
+    __m256i prod = _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32));
+    __m256i swap = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+    __m256i sum = _mm256_add_epi64(_mm256_load_si256(a + i), swap);
+    _mm256_store_si256(a + i, _mm256_add_epi64(prod, sum));
+  }
+#elif defined(__SSE2__)
+  __m128i* a = reinterpret_cast<__m128i*>(acc);
+  for (int i = 0; i != 4; ++i) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p) + i);
+    __m128i k = _mm_loadu_si128(reinterpret_cast<__m128i const*>(key) + i);
+    __m128i dk = _mm_xor_si128(d, k);
+    __m128i prod = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+    __m128i swap = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i sum = _mm_add_epi64(_mm_load_si128(a + i), swap);
+    _mm_store_si128(a + i, _mm_add_epi64(prod, sum));
+  }
+#else
+  for (int i = 0; i != 8; ++i) {
+    std::uint64_t d = read64(p + 8 * i);
+    std::uint64_t dk = d ^ key[i];
+    acc[i ^ 1] += d;
+    acc[i] += (dk & 0xffffffff) * (dk >> 32);
+  }
+#endif
+}
+
+
+// Scramble the accumulators so that input differences in the high
+// bits of each lane propagate to the low bits.
+inline void
+scramble(std::uint64_t* acc)
+{
+  for (int i = 0; i != 8; ++i) {
+    std::uint64_t a = acc[i];
+    a ^= a >> 47;
+    a ^= scramble_key_[i];
+    acc[i] = a * 0x9e3779b1u;
+  }
+}
+
+
+// Hash strings of 256 or more characters.
+std::uint64_t
+hash_long(char const* p, std::size_t n, std::uint64_t seed)
+{
+  alignas(32) std::uint64_t acc[8] = {
+    p0_, p1_, p2_, p3_, p0_ ^ seed, p1_ ^ seed, p2_ ^ seed, p3_ ^ seed
+  };
+  std::size_t stripes = n / 64;
+  for (std::size_t i = 0; i != stripes; ++i) {
+    accumulate(acc, p + 64 * i, stripe_key_ + i % stripes_per_block_);
+    if ((i + 1) % stripes_per_block_ == 0)
+      scramble(acc);
+  }
+
+  std::uint64_t h = n * p0_;
+  for (int i = 0; i != 8; i += 2)
+    h = mix(h ^ acc[i] ^ stripe_key_[i], acc[i + 1] ^ scramble_key_[i]);
+
+  // Hash the last 64 characters, which may overlap the stripes.
+  return hash_short(p + n - 64, 64, h);
+}
+
+} // namespace
+
+
+std::uint64_t
+hash_bytes(char const* first, char const* last)
+{
+  std::size_t n = last - first;
+  if (n < 256)
+    return hash_short(first, n, 0);
+  else
+    return hash_long(first, n, 0);
+}
+
+
 // Streaming.
 std::ostream&
 operator<<(std::ostream& os, String_view s)
@@ -18,17 +253,11 @@ operator<<(std::ostream& os, String_view s)
 }
 
 
-// Returns the a hash value for the characters in the symbol.
-// Adapted from an algorithm in Stroustrup's book (not sure
-// which, found the reference on StackOverflow).
+// Returns the a hash value for the characters in the view.
 std::size_t
 String_view::hash() const
 {
-  std::size_t h = 0;
-  char const* p = first;
-  while (p != last)
-    h = h << 1 ^ *p++;
-  return h;
+  return hash_bytes(first, last);
 }
 
 
@@ -8,6 +8,7 @@
 // working with character strings.
 
 #include <cstring>
+#include <cstdint>
 #include <algorithm>
 #include <string>
 #include <iosfwd>
@@ -19,6 +20,10 @@ namespace lingo
 using String = std::string;
 
 
+// Returns a 64-bit hash of the characters in [first, last).
+std::uint64_t hash_bytes(char const*, char const*);
+
+
 // A view of a string in a source file. A string view is
 // represented as a pair of pointers into text owned by
 // another object.
@@ -2,12 +2,20 @@
 // All rights reserved
 
 #include "lingo/symbol.hpp"
+#include "lingo/buffer.hpp"
 #include "lingo/print.hpp"
 #include "lingo/error.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <new>
 
 namespace lingo
 {
@@ -16,10 +24,147 @@ namespace lingo
 // -------------------------------------------------------------------------- //
 //                           Symbol table
 
+namespace
+{
+
+// The number of shards, as a power of 2.
+constexpr int shard_bits_ = 4;
+
+
+// The initial number of slots in a shard, as a power of 2.
+constexpr int initial_bits_ = 6;
+
+
+// A slot in a hash table. Empty slots have a null symbol. The
+// hash is written before the symbol is published.
+struct Slot
+{
+  std::atomic<std::size_t> hash {0};
+  std::atomic<Symbol*>     sym {nullptr};
+};
+
+
+// The hash table of a shard.
+struct Index
+{
+  Index(int bits)
+    : slots(std::size_t(1) << bits)
+    , shift(std::numeric_limits<std::size_t>::digits - bits)
+  { }
+
+  // Returns the preferred slot for the hash value `h`. The hash
+  // is multiplied by 2^64 divided by the golden ratio and the high
+  // bits are taken as the index. 
+  std::size_t home(std::size_t h) const
+  {
+    return std::size_t(h * 0x9e3779b97f4a7c15ull) >> shift;
+  }
+
+  std::vector<Slot> slots;
+  int               shift;
+};
+
+
+// Returns the symbol in `ix` with spelling `s` and hash `h`, or
+// nullptr if there is no such symbol.
+Symbol*
+find(Index const& ix, String_view s, std::size_t h)
+{
+  std::size_t mask = ix.slots.size() - 1;
+  for (std::size_t i = ix.home(h); ; i = (i + 1) & mask) {
+    Slot const& slot = ix.slots[i];
+    Symbol* sym = slot.sym.load(std::memory_order_acquire);
+    if (!sym)
+      return nullptr;
+    if (slot.hash.load(std::memory_order_relaxed) == h && String_view_eq()(sym->str, s))
+      return sym;
+  }
+}
+
+
+// Put the symbol in the first empty slot following its preferred
+// slot.
+void
+place(Index& ix, Symbol* sym, std::size_t h)
+{
+  std::size_t mask = ix.slots.size() - 1;
+  std::size_t i = ix.home(h);
+  while (ix.slots[i].sym.load(std::memory_order_relaxed))
+    i = (i + 1) & mask;
+  ix.slots[i].hash.store(h, std::memory_order_relaxed);
+  ix.slots[i].sym.store(sym, std::memory_order_release);
+}
+
+} // namespace
+
+
+// A shard of the symbol table.
+struct Symbol_table::Shard
+{
+  Shard()
+    : index(new Index(initial_bits_)), size(0)
+  { }
+
+  ~Shard()
+  {
+    delete index.load();
+    for (Index* ix : retired)
+      delete ix;
+  }
+
+  void add(Symbol*, std::size_t, bool);
+
+  std::atomic<Index*>      index;
+  std::atomic<std::size_t> size;
+  std::mutex               mutex;
+  Arena                    arena;
+  std::vector<Index*>      retired;
+};
+
+
+// Add a symbol with hash `h` to the shard. If the load factor would
+// exceed 3/4, the table is replaced by one twice its size. When the
+// table is concurrent, the old table is retired rather than deleted.
+void
+Symbol_table::Shard::add(Symbol* sym, std::size_t h, bool concurrent)
+{
+  Index* ix = index.load(std::memory_order_relaxed);
+  std::size_t n = size.load(std::memory_order_relaxed);
+  if ((n + 1) * 4 > ix->slots.size() * 3) {
+    Index* bigger = new Index(std::numeric_limits<std::size_t>::digits - ix->shift + 1);
+    for (Slot const& slot : ix->slots) {
+      if (Symbol* p = slot.sym.load(std::memory_order_relaxed))
+        place(*bigger, p, slot.hash.load(std::memory_order_relaxed));
+    }
+    index.store(bigger, std::memory_order_release);
+    if (concurrent)
+      retired.push_back(ix);
+    else
+      delete ix;
+    ix = bigger;
+  }
+  place(*ix, sym, h);
+  size.store(n + 1, std::memory_order_relaxed);
+}
+
+
+Symbol_table::Symbol_table()
+  : shards_(new Shard[std::size_t(1) << shard_bits_]), concurrent_(false), next_(0)
+  , base_(nullptr), base_size_(0), base_shift_(0)
+{ }
+
+
 Symbol_table::~Symbol_table()
 {
-  for (auto p : map_)
-    delete p.second;
+  delete [] shards_;
+}
+
+
+// Returns the shard for the hash value `h`.
+inline Symbol_table::Shard&
+Symbol_table::shard(std::size_t h) const
+{
+  return shards_[h & ((std::size_t(1) << shard_bits_) - 1)];
 }
 
 
@@ -31,48 +176,337 @@ Symbol_table::~Symbol_table()
 // been previously installed as a keyword, will simply return the
 // keyword.
 //
-// A symbol's kind can be modified after initialization if needed.
+// A symbol's kind can be modified after initialization if needed
+// (see set_kind).
 Symbol&
 Symbol_table::insert(String_view s, int k)
 {
-  auto ins = map_.insert({s, nullptr});
-  if (ins.second) {
-    // Create a new symbol for the given string.
-    Symbol* sym = new Symbol(s.str(), k);
-    ins.first->second = sym;
+  std::size_t h = s.hash();
+  if (Symbol* sym = find_base(s, h))
+    return *sym;
+  Shard& sh = shard(h);
+  if (Symbol* sym = find(*sh.index.load(std::memory_order_acquire), s, h))
     return *sym;
-  } else {
-    // Return the existing symbol.
-    return *ins.first->second;
+
+  // Another thread may have inserted the symbol before we
+  // acquired the lock.
+  std::unique_lock<std::mutex> lock(sh.mutex, std::defer_lock);
+  if (concurrent_) {
+    lock.lock();
+    if (Symbol* sym = find(*sh.index.load(std::memory_order_relaxed), s, h))
+      return *sym;
   }
+
+  Symbol* sym = make_symbol(sh, s, k);
+  sh.add(sym, h, concurrent_);
+  return *sym;
 }
 
 
+// Allocate a new symbol in the shard's arena and assign its id.
+// Its characters are copied into the space following the symbol.
+// The symbol's attributes are stored before it is published.
+Symbol*
+Symbol_table::make_symbol(Shard& sh, String_view s, int k)
+{
+  void* p = sh.arena.allocate(sizeof(Symbol) + s.size() + 1, alignof(Symbol));
+  char* first = static_cast<char*>(p) + sizeof(Symbol);
+  char* last = std::copy(s.begin(), s.end(), first);
+  *last = 0;
+
+  Symbol_id n = next_.fetch_add(1, std::memory_order_relaxed);
+  lingo_alert(n != no_symbol, "too many symbols");
+  int& kind = kinds_[n];
+  kind = k;
+  Symbol* sym = new (p) Symbol(String_view(first, last), kind, n);
+  syms_[n] = sym;
+  lengths_[n] = s.size();
+  return sym;
+}
+
+
+// Change the token kind of a symbol. This is not thread safe.
+void
+Symbol_table::set_kind(Symbol& sym, int k)
+{
+  sym.kind = k;
+}
+
+
+// Returns the symbol with the given spelling, or nullptr if
+// there is no such symbol. This does not take a lock.
 Symbol*
 Symbol_table::lookup(String_view s) const
 {
-  auto iter = map_.find(s);
-  if (iter != map_.end())
-    return iter->second;
-  else
-    return nullptr;
+  std::size_t h = s.hash();
+  if (Symbol* sym = find_base(s, h))
+    return sym;
+  return find(*shard(h).index.load(std::memory_order_acquire), s, h);
 }
 
 
+// Returns the number of bytes allocated for symbols, their 
+// characters, the hash tables, and the attribute arrays.
+std::size_t
+Symbol_table::memory() const
+{
+  std::size_t n = 0;
+  for (std::size_t i = 0; i != std::size_t(1) << shard_bits_; ++i) {
+    Shard const& sh = shards_[i];
+    n += sh.arena.capacity();
+    n += sh.index.load()->slots.capacity() * sizeof(Slot);
+    for (Index const* ix : sh.retired)
+      n += ix->slots.capacity() * sizeof(Slot);
+  }
+  n += syms_.memory() + kinds_.memory() + lengths_.memory();
+  return n;
+}
+
+
+// -------------------------------------------------------------------------- //
+//                              Symbol images
+
+// An image file has the following layout:
+//
+//    header
+//    hash table   -- slots of Image_slot
+//    symbols      -- count records of Image_symbol, in id order
+//    characters   -- the NUL-terminated spellings
+//
+// All offsets are from the start of the file. The header records
+// the hash of a fixed string so that an image written with a
+// different hash function is rejected.
+//
+// TODO: Images are written and read in native byte order.
+
 namespace
 {
 
-// The global symbol table.
-Symbol_table sym_;
+constexpr char image_magic_[8] = {'l', 'i', 'n', 'g', 'o', 's', 'y', 'm'};
+
+
+constexpr std::uint32_t image_format_ = 1;
+
+
+struct Image_header
+{
+  char          magic[8];
+  std::uint32_t format;
+  std::uint32_t count;    // Number of symbols
+  std::uint32_t bits;     // Number of slots, as a power of 2
+  std::uint32_t reserved;
+  std::uint64_t hash;     // Hash of the magic string
+  std::uint64_t symbols;  // Offset of the symbol records
+  std::uint64_t chars;    // Offset of the characters
+  std::uint64_t size;     // Size of the image
+};
+
+
+struct Image_symbol
+{
+  std::uint64_t offset;   // Offset of the spelling in the characters
+  std::uint32_t length;
+  std::int32_t  kind;
+};
+
+
+template<typename T>
+inline void
+write(std::ostream& os, T const& x)
+{
+  os.write(reinterpret_cast<char const*>(&x), sizeof(T));
+}
+
+
+// Returns the preferred slot for the hash value `h` in a table
+// whose index is `shift` bits shorter than a hash.
+inline std::size_t
+image_home(std::uint64_t h, int shift)
+{
+  return std::size_t((h * 0x9e3779b97f4a7c15ull) >> shift);
+}
+
+
+inline std::uint64_t
+magic_hash()
+{
+  return hash_bytes(image_magic_, image_magic_ + sizeof(image_magic_));
+}
 
 } // namespace
 
 
-// Returns the global symbol table.
-Symbol_table& 
-symbols()
+// A slot in the hash table of an image. Empty slots have no
+// symbol.
+struct Symbol_table::Image_slot
+{
+  std::uint64_t hash;
+  Symbol_id     id;
+  std::uint32_t reserved;
+};
+
+
+// Returns the base symbol with spelling `s` and hash `h`, or
+// nullptr if there is no such symbol. The base never changes
+// after it is loaded, so this does not need synchronization.
+Symbol*
+Symbol_table::find_base(String_view s, std::size_t h) const
+{
+  if (!base_)
+    return nullptr;
+  std::size_t mask = (std::size_t(1) << (64 - base_shift_)) - 1;
+  for (std::size_t i = image_home(h, base_shift_); ; i = (i + 1) & mask) {
+    Image_slot const& slot = base_[i];
+    if (slot.id == no_symbol)
+      return nullptr;
+    if (slot.hash == h) {
+      Symbol* sym = syms_[slot.id];
+      if (String_view_eq()(sym->str, s))
+        return sym;
+    }
+  }
+}
+
+
+// Write an image of the table to the file at `path`. The table
+// is kept at most half full. The image is written to a temporary
+// file and then renamed. Returns false if the image could not be
+// written.
+//
+// This must not be called while other threads are inserting
+// symbols.
+bool
+Symbol_table::save(char const* path) const
+{
+  std::uint32_t n = size();
+  std::uint32_t bits = 1;
+  while ((std::size_t(1) << bits) < std::size_t(n) * 2)
+    ++bits;
+  int shift = 64 - bits;
+
+  // Build the hash table.
+  Image_slot empty {0, no_symbol, 0};
+  std::vector<Image_slot> slots(std::size_t(1) << bits, empty);
+  std::size_t mask = slots.size() - 1;
+  std::uint64_t chars = 0;
+  for (Symbol_id id = 0; id != n; ++id) {
+    String_view s = spelling(id);
+    std::uint64_t h = s.hash();
+    std::size_t i = image_home(h, shift);
+    while (slots[i].id != no_symbol)
+      i = (i + 1) & mask;
+    slots[i] = {h, id, 0};
+    chars += s.size() + 1;
+  }
+
+  Image_header hdr;
+  std::copy(image_magic_, image_magic_ + sizeof(image_magic_), hdr.magic);
+  hdr.format = image_format_;
+  hdr.count = n;
+  hdr.bits = bits;
+  hdr.reserved = 0;
+  hdr.hash = magic_hash();
+  hdr.symbols = sizeof(Image_header) + slots.size() * sizeof(Image_slot);
+  hdr.chars = hdr.symbols + std::uint64_t(n) * sizeof(Image_symbol);
+  hdr.size = hdr.chars + chars;
+
+  std::string temp = std::string(path) + ".tmp";
+  {
+    std::ofstream os(temp, std::ios::binary);
+    write(os, hdr);
+    os.write(reinterpret_cast<char const*>(slots.data()), slots.size() * sizeof(Image_slot));
+    std::uint64_t off = 0;
+    for (Symbol_id id = 0; id != n; ++id) {
+      write(os, Image_symbol {off, std::uint32_t(length(id)), kind(id)});
+      off += length(id) + 1;
+    }
+    for (Symbol_id id = 0; id != n; ++id) {
+      String_view s = spelling(id);
+      os.write(s.begin(), s.size());
+      os.put(0);
+    }
+    if (!os) {
+      std::remove(temp.c_str());
+      return false;
+    }
+  }
+  return std::rename(temp.c_str(), path) == 0;
+}
+
+
+// Map the image at `path` and make it the base of the table. The
+// table must be empty. Returns false if the image cannot be read or
+// is not valid, in which case the table is unchanged.
+//
+// The hash table and spellings are used in place. Each base symbol
+// still needs a symbol object, but these are allocated in a single
+// block and filled in one pass over the image, without hashing.
+//
+// This must not be called while other threads are using the table.
+bool
+Symbol_table::load(char const* path)
 {
-  return sym_;
+  lingo_assert(size() == 0);
+  std::unique_ptr<Mapped_region> map(new Mapped_region(path));
+  if (!*map || map->size() < sizeof(Image_header))
+    return false;
+
+  // Validate the image.
+  char const* data = map->data();
+  Image_header const& hdr = *reinterpret_cast<Image_header const*>(data);
+  if (!std::equal(image_magic_, image_magic_ + sizeof(image_magic_), hdr.magic))
+    return false;
+  if (hdr.format != image_format_ || hdr.hash != magic_hash())
+    return false;
+  if (hdr.bits == 0 || hdr.bits >= 32 || hdr.count >= (std::uint64_t(1) << hdr.bits))
+    return false;
+  std::uint64_t slots = std::uint64_t(1) << hdr.bits;
+  if (hdr.symbols != sizeof(Image_header) + slots * sizeof(Image_slot)
+      || hdr.chars != hdr.symbols + std::uint64_t(hdr.count) * sizeof(Image_symbol)
+      || hdr.size != map->size()
+      || hdr.chars > hdr.size)
+    return false;
+
+  // Lookups in the hash table stop at an empty slot, so there
+  // must be at least one.
+  Image_slot const* base = reinterpret_cast<Image_slot const*>(data + sizeof(Image_header));
+  std::uint64_t empty = 0;
+  for (std::uint64_t i = 0; i != slots; ++i) {
+    if (base[i].id == no_symbol)
+      ++empty;
+    else if (base[i].id >= hdr.count)
+      return false;
+  }
+  if (empty == 0)
+    return false;
+  Image_symbol const* recs = reinterpret_cast<Image_symbol const*>(data + hdr.symbols);
+  char const* chars = data + hdr.chars;
+  std::uint64_t limit = hdr.size - hdr.chars;
+  for (Symbol_id id = 0; id != hdr.count; ++id) {
+    Image_symbol const& rec = recs[id];
+    if (rec.offset >= limit || rec.length >= limit - rec.offset || chars[rec.offset + rec.length] != 0)
+      return false;
+  }
+
+  // Create the base symbols.
+  Arena& arena = shards_[0].arena;
+  Symbol* syms = static_cast<Symbol*>(arena.allocate(hdr.count * sizeof(Symbol), alignof(Symbol)));
+  for (Symbol_id id = 0; id != hdr.count; ++id) {
+    Image_symbol const& rec = recs[id];
+    char const* first = chars + rec.offset;
+    int& kind = kinds_[id];
+    kind = rec.kind;
+    Symbol* sym = new (syms + id) Symbol(String_view(first, first + rec.length), kind, id);
+    syms_[id] = sym;
+    lengths_[id] = rec.length;
+  }
+
+  next_.store(hdr.count, std::memory_order_relaxed);
+  base_ = base;
+  base_size_ = hdr.count;
+  base_shift_ = 64 - hdr.bits;
+  image_ = std::move(map);
+  return true;
 }
 
 
@@ -9,17 +9,26 @@
 // file and affiliated data (e.g., bindings).
 
 #include "lingo/string.hpp"
+#include "lingo/error.hpp"
 #include "lingo/integer.hpp"
+#include "lingo/memory.hpp"
 
+#include <atomic>
+#include <cassert>
+#include <cstdint>
 #include <cstring>
-#include <list>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 
 namespace lingo
 {
 
+class Mapped_region;
+struct Binding;
+
+
 // -------------------------------------------------------------------------- //
 //                                  Symbols
 
@@ -27,33 +36,76 @@ namespace lingo
 constexpr int unknown_tok = -1;
 
 
+// A symbol id is the index of a symbol in its table. Ids are
+// assigned densely, from 0, in order of insertion.
+using Symbol_id = std::uint32_t;
+
+
+// The id of no symbol.
+constexpr Symbol_id no_symbol = -1;
+
+
 // A Symbol represents a lexeme saved in the symbol table and
 // its associated attributes. The string representation of symbols 
 // are represented as a pair of pointers into a character array.
 // Additional attributes include the kind of token and the token
 // specific data.
 //
-// Note that the symbol owns the pointer to its string view and is
-// responsible for de-allocating that memory.
+// The characters of a symbol are owned by its symbol table. For
+// symbols inserted into the table, they are stored immediately
+// after the symbol. For symbols loaded from an image, they are in
+// the mapped image (see Symbol_table::load). In either case, they
+// are followed by a null character, so str.begin() is a C string.
 //
 // The symbol also associates a token kind, allowing for efficient
 // token construction. Most symbols are inserted with the token
 // kind already known. However, for tokens like identifiers, integers,
-// and real values, the token kind must be assigned later.
+// and real values, the token kind must be assigned later (see
+// Symbol_table::set_kind). The kind is stored only in the table's
+// per-id array. The kind member of a symbol refers to the symbol's
+// element of that array, so reading or assigning it reads or
+// assigns the kind seen by tokens.
+//
+// A symbol also refers to its innermost binding in the current
+// scope stack, if any (see scope.hpp). Bindings are not part of
+// the symbol's value, so they can be changed through a const
+// symbol.
 // 
 struct Symbol
 {
-  Symbol(String const& s, int k)
-    : str(s), kind(k)
+  // A reference to the kind of a symbol in its table's array of
+  // kinds. It converts to and can be assigned an int.
+  class Kind
+  {
+  public:
+    explicit Kind(int& k)
+      : kind_(&k)
+    { }
+
+    Kind& operator=(int k) { *kind_ = k; return *this; }
+    Kind& operator=(Kind const& k) { return *this = int(k); }
+
+    operator int() const { return *kind_; }
+
+  private:
+    int* kind_;
+  };
+
+  Symbol(String_view s, int& k, Symbol_id n)
+    : str(s), kind(k), id(n), binding(nullptr)
   { }
 
-  String_view view() const { return make_view(str); }
+  String_view view() const { return str; }
 
-  String str;  // The string view
-  int    kind; // The kind of token
+  String_view      str;     // The string view
+  Kind             kind;    // The kind of token
+  Symbol_id        id;      // The index of the symbol in its table
+  mutable Binding* binding; // The innermost binding
 };
 
 
+// Symbols are unique, so two symbols in the same table are
+// equal only when they are the same object.
 inline bool
 operator==(Symbol const& a, Symbol const& b)
 {
@@ -68,6 +120,140 @@ operator!=(Symbol const& a, Symbol const& b)
 }
 
 
+// -------------------------------------------------------------------------- //
+//                             Symbol arrays
+
+// A symbol array associates a value with each symbol id. These are
+// used to store the attributes of symbols in separate arrays, so
+// that passes that use only one attribute (e.g., the token kind)
+// do not load the others.
+//
+// A symbol array behaves as an unbounded array whose elements are
+// initially value-initialized. Storage is allocated in chunks of
+// increasing size as elements are written; chunk k holds 2^(k + 10)
+// elements. Elements never move, so references to them remain valid.
+// Chunks are allocated atomically, so threads can write different
+// elements concurrently, and they can read elements written by
+// other threads once those writes are visible.
+template<typename T>
+class Symbol_array
+{
+public:
+  Symbol_array();
+  ~Symbol_array();
+
+  Symbol_array(Symbol_array const&) = delete;
+  Symbol_array& operator=(Symbol_array const&) = delete;
+
+  T  operator[](Symbol_id) const;
+  T& operator[](Symbol_id);
+
+  std::size_t memory() const;
+
+private:
+  static constexpr int base_bits = 10;
+  static constexpr int chunks = 32 - base_bits;
+
+  static int       chunk(Symbol_id);
+  static Symbol_id offset(Symbol_id, int);
+
+  T* allocate(int);
+
+  std::atomic<T*> chunks_[chunks];
+};
+
+
+template<typename T>
+Symbol_array<T>::Symbol_array()
+{
+  for (auto& c : chunks_)
+    c.store(nullptr, std::memory_order_relaxed);
+}
+
+
+template<typename T>
+Symbol_array<T>::~Symbol_array()
+{
+  for (auto& c : chunks_)
+    delete [] c.load(std::memory_order_relaxed);
+}
+
+
+// Returns the chunk containing the nth element. No element has
+// the id no_symbol, which would otherwise wrap to chunk -1.
+template<typename T>
+inline int
+Symbol_array<T>::chunk(Symbol_id n)
+{
+  assert(n != no_symbol);
+  return 31 - __builtin_clz(n + (1u << base_bits)) - base_bits;
+}
+
+
+// Returns the offset of the nth element in chunk `c`.
+template<typename T>
+inline Symbol_id
+Symbol_array<T>::offset(Symbol_id n, int c)
+{
+  return n + (1u << base_bits) - (1u << (c + base_bits));
+}
+
+
+// Returns the nth element.
+template<typename T>
+inline T
+Symbol_array<T>::operator[](Symbol_id n) const
+{
+  int c = chunk(n);
+  if (T const* p = chunks_[c].load(std::memory_order_acquire))
+    return p[offset(n, c)];
+  return T();
+}
+
+
+// Returns a reference to the nth element, allocating storage for
+// it if needed.
+template<typename T>
+inline T&
+Symbol_array<T>::operator[](Symbol_id n)
+{
+  int c = chunk(n);
+  T* p = chunks_[c].load(std::memory_order_acquire);
+  if (!p)
+    p = allocate(c);
+  return p[offset(n, c)];
+}
+
+
+// Allocate the chunk `c`. If another thread allocates the chunk
+// first, its chunk is used instead.
+template<typename T>
+T*
+Symbol_array<T>::allocate(int c)
+{
+  T* p = new T[std::size_t(1) << (c + base_bits)]();
+  T* q = nullptr;
+  if (chunks_[c].compare_exchange_strong(q, p, std::memory_order_acq_rel)) 
+    return p;
+  delete [] p;
+  return q;
+}
+
+
+// Returns the number of bytes allocated for elements.
+template<typename T>
+std::size_t
+Symbol_array<T>::memory() const
+{
+  std::size_t n = 0;
+  for (int c = 0; c != chunks; ++c) {
+    if (chunks_[c].load(std::memory_order_relaxed))
+      n += sizeof(T) << (c + base_bits);
+  }
+  return n;
+}
+
+
 // -------------------------------------------------------------------------- //
 //                           Symbol table
 
@@ -76,22 +262,51 @@ operator!=(Symbol const& a, Symbol const& b)
 // etc.). The symbol table also supports efficient insertion and 
 // lookup of those strings.
 //
-// The symbol table is implemented as a linked list of symbols 
-// with a side table to support efficient lookup.
+// Each symbol and its characters are allocated together in an
+// arena, and all of them are freed at once when the table is
+// destroyed. Symbols are found through an open addressing hash
+// table with linear probing. Each slot stores the hash of a symbol's
+// string along with the symbol, so most probes that do not match
+// never touch the symbol.
+//
+// The table is divided into shards, selected by the low bits of
+// a string's hash. Each shard has its own arena and hash table.
+//
+// The table can be used by multiple threads if it is made
+// concurrent (see set_concurrent). Looking up a symbol never
+// takes a lock: entries never move once inserted, and a shard's
+// table is replaced atomically when it grows. Inserting a new
+// symbol locks its shard, so insertions into different shards
+// proceed in parallel. Every spelling has exactly one symbol. In
+// a concurrent table, the tables replaced by growth are kept
+// until the symbol table is destroyed, since other threads may
+// still be reading them.
+//
+// Each symbol has an id, and its kind and the length of its spelling
+// are also stored in symbol arrays indexed by id. Tokens and other
+// frequently copied objects can refer to symbols by their 4-byte id
+// rather than by pointer.
 //
-// TODO: Use a bump alloctor for the hash table and the strings.
-// Because the table is only ever cleared on program exit, it
-// would be far more effecient to simply blow away all pages
-// allocated to the symbol table.
+// A table can be saved to an image file containing the spellings
+// and kinds of its symbols and a hash table over them. Images store
+// offsets rather than pointers, so they can be mapped at any address.
+// Loading an image into an empty table maps it read-only and makes
+// its symbols the base of the table, with ids 0 through n-1. The
+// base is searched before the shards, and symbols inserted later
+// are added to the shards as usual. This lets a language's keywords
+// and other predefined names be loaded without hashing or inserting
+// them one at a time.
 class Symbol_table
 {
-  using Hash = String_view_hash;
-  using Eq = String_view_eq;
-  using Map = std::unordered_map<String_view, Symbol*, Hash, Eq>;
-
 public:
+  struct Shard;
+
+  Symbol_table();
   ~Symbol_table();
 
+  Symbol_table(Symbol_table const&) = delete;
+  Symbol_table& operator=(Symbol_table const&) = delete;
+
   Symbol& insert(String_view, int);
   Symbol& insert(char const*, int);
   Symbol& insert(char const*, char const*, int);
@@ -100,8 +315,54 @@ public:
   Symbol* lookup(char const*) const;
   Symbol* lookup(char const*, char const*) const;
 
+  // Returns the number of symbols in the table.
+  std::size_t size() const { return next_.load(std::memory_order_relaxed); }
+
+  // Symbols by id.
+  Symbol&     symbol(Symbol_id n) const   { return *syms_[n]; }
+  int         kind(Symbol_id n) const     { return kinds_[n]; }
+  int         length(Symbol_id n) const   { return lengths_[n]; }
+  String_view spelling(Symbol_id n) const { return syms_[n]->str; }
+
+  void set_kind(Symbol&, int);
+
+  // Returns the number of bytes used by the table.
+  std::size_t memory() const;
+
+  // Concurrency. This must not be changed while other threads
+  // are using the table.
+  bool is_concurrent() const     { return concurrent_; }
+  void set_concurrent(bool b)    { concurrent_ = b; }
+
+  // Images. An image is a snapshot of the table that can be
+  // loaded as the read-only base of an empty table.
+  bool save(char const*) const;
+  bool load(char const*);
+
+  // Returns the number of symbols in the base image.
+  std::size_t base_size() const { return base_size_; }
+
 private:
-  Map  map_;
+  struct Image_slot;
+
+  Shard&  shard(std::size_t) const;
+  Symbol* make_symbol(Shard&, String_view, int);
+  Symbol* find_base(String_view, std::size_t) const;
+
+  Shard*                 shards_;
+  bool                   concurrent_;
+  std::atomic<Symbol_id> next_;
+
+  // Attributes by id.
+  Symbol_array<Symbol*> syms_;
+  Symbol_array<int>     kinds_;
+  Symbol_array<int>     lengths_;
+
+  // The base image and its hash table.
+  std::unique_ptr<Mapped_region> image_;
+  Image_slot const*              base_;
+  std::size_t                    base_size_;
+  int                            base_shift_;
 };
 
 
@@ -133,7 +394,15 @@ Symbol_table::lookup(char const* f, char const* l) const
 }
 
 
-Symbol_table& symbols();
+// Returns the global symbol table. The table is local to this
+// function so that it is not exposed in the header; the accessor
+// is inline because every token's kind is looked up through it.
+inline Symbol_table&
+symbols()
+{
+  static Symbol_table sym_;
+  return sym_;
+}
 
 
 // Returns the symbol correspondng to `str`, inserting a new
@@ -175,10 +444,10 @@ get_symbol(String const& s, int k = unknown_tok)
 // Return a pointer to a unique representation of the
 // given string. Inserts a symbol into the symbol table
 // where appropreate.
-inline String const*
+inline char const*
 get_string(char const* str)
 {
-  return &get_symbol(str).str;
+  return get_symbol(str).str.begin();
 }
 
 
@@ -0,0 +1,81 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#include "thread.hpp"
+
+#include <algorithm>
+
+namespace lingo
+{
+
+// Start `n` worker threads.
+Thread_pool::Thread_pool(int n)
+  : stop_(false)
+{
+  for (int i = 0; i < n; ++i)
+    threads_.emplace_back([this]() { run(); });
+}
+
+
+// Run all remaining tasks and join the workers.
+Thread_pool::~Thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  ready_.notify_all();
+  for (std::thread& t : threads_)
+    t.join();
+}
+
+
+namespace
+{
+
+// True for threads that are workers in a thread pool.
+thread_local bool worker_ = false;
+
+} // namespace
+
+
+// The worker loop. Run tasks until the pool is stopped and
+// there are no more tasks.
+void
+Thread_pool::run()
+{
+  worker_ = true;
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty())
+        return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+
+// Returns the global thread pool. The pool is created on first
+// use and has one worker per hardware thread.
+Thread_pool&
+thread_pool()
+{
+  static Thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+
+// Returns true if the calling thread is a worker in a thread pool.
+bool
+is_worker_thread()
+{
+  return worker_;
+}
+
+
+} // namespace lingo
@@ -0,0 +1,82 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#ifndef LINGO_THREAD_HPP
+#define LINGO_THREAD_HPP
+
+// The thread module provides a pool of worker threads that is
+// shared by facilities that can perform work in the background
+// or in parallel (e.g., building line maps and loading files).
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lingo
+{
+
+// A thread pool runs tasks on a fixed set of worker threads.
+// Tasks are run in the order they are submitted. When the pool
+// is destroyed, all submitted tasks are run before the workers
+// are joined.
+//
+// Note that a task must not wait for other tasks submitted to
+// the pool; if all workers are waiting, those tasks never run.
+// Use is_worker_thread() to avoid submitting tasks from a task.
+class Thread_pool
+{
+public:
+  explicit Thread_pool(int);
+  ~Thread_pool();
+
+  Thread_pool(Thread_pool const&) = delete;
+  Thread_pool& operator=(Thread_pool const&) = delete;
+
+  // Returns the number of worker threads.
+  int size() const { return threads_.size(); }
+
+  template<typename F>
+  std::future<typename std::result_of<F()>::type> submit(F);
+
+private:
+  void run();
+
+  std::vector<std::thread>          threads_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex                        mutex_;
+  std::condition_variable           ready_;
+  bool                              stop_;
+};
+
+
+// Submit the task `f` to the pool. Returns a future that holds the 
+// result of the task.
+template<typename F>
+std::future<typename std::result_of<F()>::type>
+Thread_pool::submit(F f)
+{
+  using R = typename std::result_of<F()>::type;
+  auto task = std::make_shared<std::packaged_task<R()>>(std::move(f));
+  std::future<R> result = task->get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back([task]() { (*task)(); });
+  }
+  ready_.notify_one();
+  return result;
+}
+
+
+Thread_pool& thread_pool();
+
+bool is_worker_thread();
+
+
+} // namespace lingo
+
+#endif
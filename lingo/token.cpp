@@ -6,6 +6,7 @@
 #include "lingo/symbol.hpp"
 #include "lingo/error.hpp"
 
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -20,8 +21,27 @@ namespace lingo
 namespace
 {
 
-std::unordered_map<int, char const*> name_;
-std::unordered_map<int, Symbol*> spelling_;
+// A hash of the installed tokens (FNV-1a).
+std::uint64_t version_ = 14695981039346656037ull;
+
+
+// Update the token set version with the bytes in [first, last).
+void
+update_version(void const* first, std::size_t n)
+{
+  unsigned char const* p = static_cast<unsigned char const*>(first);
+  for (std::size_t i = 0; i != n; ++i)
+    version_ = (version_ ^ p[i]) * 1099511628211ull;
+}
+
+
+// Returns the installed tokens for modification. Only
+// install_token() adds to the table.
+std::vector<Token_info>&
+installed_tokens()
+{
+  return const_cast<std::vector<Token_info>&>(token_info());
+}
 
 } // namespace
 
@@ -31,13 +51,32 @@ std::unordered_map<int, Symbol*> spelling_;
 void 
 install_token(int kind, char const* name, char const* spelling)
 {
-  lingo_alert(name_.count(kind) == 0, "existing token kind '{}'", name);
+  lingo_alert(kind >= 0, "invalid token kind '{}'", name);
+  std::vector<Token_info>& tokens = installed_tokens();
+  if (std::size_t(kind) >= tokens.size())
+    tokens.resize(kind + 1, Token_info {nullptr, no_symbol});
+  Token_info& info = tokens[kind];
+  lingo_alert(!info.name, "existing token kind '{}'", name);
+
+  // Save the token name and the symbol for its spelling.
+  info.name = name;
+  info.spelling = get_symbol(spelling, kind).id;
+
+  // Update the token set version. Note that the terminating
+  // null characters are included.
+  update_version(&kind, sizeof(kind));
+  update_version(name, std::strlen(name) + 1);
+  update_version(spelling, std::strlen(spelling) + 1);
+}
 
-  // Save the token name.
-  name_.insert({kind, name});
-  
-  // Save the symbol for the spelling of the token.
-  spelling_.insert({kind, &get_symbol(spelling, kind)});
+
+// Returns a value that identifies the set of installed tokens.
+// This is a hash of the kind, name, and spelling of each token,
+// in the order they were installed.
+std::uint64_t
+token_set_version()
+{
+  return version_;
 }
 
 
@@ -46,11 +85,10 @@ install_token(int kind, char const* name, char const* spelling)
 char const* 
 get_token_name(int kind)
 {
-  auto iter = name_.find(kind);
-  if (iter == name_.end())
-    return "<unspecified-token>";
-  else
-    return iter->second;
+  std::vector<Token_info> const& tokens = token_info();
+  if (0 <= kind && std::size_t(kind) < tokens.size() && tokens[kind].name)
+    return tokens[kind].name;
+  return "<unspecified-token>";
 }
 
 
@@ -59,15 +97,13 @@ get_token_name(int kind)
 char const* 
 get_token_spelling(int kind)
 {
-  auto iter = spelling_.find(kind);
-  if (iter == spelling_.end())
+  Symbol_id n = get_token_symbol(kind);
+  if (n == no_symbol)
     return "<unspecified-token>";
-  else
-    return iter->second->str.c_str();
+  return symbols().spelling(n).begin();
 }
 
 
-
 // Initialize a token whose symbol is the string [str, str + len).
 // The token kind is taken from the symbol table.
 Token::Token(Location loc, char const* str, int len)
@@ -80,9 +116,9 @@ Token::Token(Location loc, char const* str, int len)
 // corresponding to the spelling of this token has not been installed,
 // behavior is undefined.
 Token::Token(Location loc, char const* first, char const* last)
-  : loc_(loc), sym_(lookup_symbol(first, last))
+  : loc_(loc), sym_(lookup_symbol(first, last)->id)
 {
-  lingo_alert(kind() != unknown_tok, "unknown token '{}'", sym_->str);
+  lingo_alert(kind() != unknown_tok, "unknown token '{}'", str().str());
 }
 
 
@@ -101,47 +137,74 @@ Token::Token(Location loc, int k, char const* str, int len)
 // FIXME: This potentially allows an existing symbol with
 // an unknown binding to 
 Token::Token(Location loc, int k, char const* first, char const* last)
-  : loc_(loc), sym_(&get_symbol(first, last, k))
+  : loc_(loc), sym_(get_symbol(first, last, k).id)
 { }
 
 
-// Initialize a token with the properties of the given symbol.
+// Initialize a token with the properties of the given symbol,
+// which must be in the global symbol table.
 Token::Token(Location loc, Symbol& sym)
-  : loc_(loc), sym_(&sym)
+  : loc_(loc), sym_(sym.id)
 { }
 
 
 // -------------------------------------------------------------------------- //
-//                              Token stream
+//                              Token buffers
 
-Token const& 
-Token_stream::peek() const
+Token_buffer::Token_buffer(Token_list const& toks)
 {
-  assert(!eof());
-  return *first_;
+  reserve(toks.size());
+  for (Token const& tok : toks)
+    push_back(tok);
 }
 
 
-Token const&
-Token_stream::peek(int n) const
-{
-  assert(n <= (last_ - first_));
-  return *(first_ + n);
-}
+// -------------------------------------------------------------------------- //
+//                              Token stream
 
+Lazy_token_stream::Lazy_token_stream(Token_source src)
+  : source_(std::move(src)), size_(0), done_(false), pos_(0)
+  , track_(&input_location_of, this)
+{ }
+
+
+constexpr int Lazy_token_stream::chunk_bits;
+constexpr std::size_t Lazy_token_stream::chunk_size;
 
-Token const& 
-Token_stream::get()
+
+// Pull the next token from the source, allocating a new chunk
+// if needed. Returns false at the end of input.
+bool
+Lazy_token_stream::pull() const
 {
-  assert(!eof());
+  if (done_)
+    return false;
+  Token tok;
+  {
+    Tracker_suspension s(track_.tracker);
+    tok = source_();
+  }
+  if (!tok) {
+    done_ = true;
+    return false;
+  }
+  if ((size_ & (chunk_size - 1)) == 0)
+    chunks_.emplace_back(new Token[chunk_size]);
+  chunks_.back()[size_ & (chunk_size - 1)] = tok;
+  ++size_;
+  return true;
+}
 
-  // Save the token's location as the input location.
-  set_input_location(location());
 
-  // Advance the token, return the previous value.
-  Token const& tok = *first_;  
-  ++first_;
-  return tok;
+// Returns the location of the last token read from the stream
+// `p`, or no location if no tokens have been read.
+Location
+Lazy_token_stream::input_location_of(void const* p)
+{
+  Lazy_token_stream const& s = *static_cast<Lazy_token_stream const*>(p);
+  if (s.pos_ == 0)
+    return Location::none;
+  return s.at(s.pos_ - 1).location();
 }
 
 
@@ -171,7 +234,7 @@ debug(Printer& p, Token const& tok)
 std::ostream&
 operator<<(std::ostream& os, Token const& tok)
 {
-  return os << *tok.str();
+  return os << tok.str();
 }
 
 
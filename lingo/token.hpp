@@ -13,7 +13,11 @@
 #include "lingo/print.hpp"
 #include "lingo/debug.hpp"
 
+#include <cassert>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 #include <tuple>
 
@@ -33,6 +37,39 @@ void install_token(int, char const*, char const*);
 char const* get_token_name(int);
 char const* get_token_spelling(int);
 
+std::uint64_t token_set_version();
+
+
+// Information about an installed token kind.
+struct Token_info
+{
+  char const* name;     // The name of the kind
+  Symbol_id   spelling; // The symbol of its spelling
+};
+
+
+// Returns the installed tokens, indexed by kind. Kinds that have
+// not been installed have no name. Use install_token() to add
+// entries.
+inline std::vector<Token_info> const&
+token_info()
+{
+  static std::vector<Token_info> info_;
+  return info_;
+}
+
+
+// Returns the symbol of the spelling of the token kind `k`, or
+// no_symbol if it has not been installed.
+inline Symbol_id
+get_token_symbol(int k)
+{
+  std::vector<Token_info> const& info = token_info();
+  if (0 <= k && std::size_t(k) < info.size())
+    return info[k].spelling;
+  return no_symbol;
+}
+
 
 // -------------------------------------------------------------------------- //
 //                            Token class
@@ -43,7 +80,9 @@ char const* get_token_spelling(int);
 //
 // Each token indexes an entry in the symbol table, which stores 
 // additional attributes associated with the token  (e.g. scope 
-// bindings, numeric interpretation of values, etc.).
+// bindings, numeric interpretation of values, etc.). A token
+// stores the id of its symbol in the global symbol table, so
+// a token occupies 8 bytes.
 //
 // Note that -1 is reserved as a special token kind, indicating an
 // error.
@@ -52,7 +91,7 @@ class Token
 public:
   // Construct an error token.
   Token()
-    : loc_(), sym_(nullptr)
+    : loc_(), sym_(no_symbol)
   { }
 
   Token(Location, char const*, int);
@@ -60,8 +99,9 @@ public:
   Token(Location, int, char const*, int);
   Token(Location, int, char const*, char const*);
   Token(Location, Symbol&);
+  Token(Location, int);
 
-  explicit operator bool() const { return sym_ && kind() != unknown_tok; }
+  explicit operator bool() const { return sym_ != no_symbol && kind() != unknown_tok; }
 
   // Observers
   char const* token_name() const { return get_token_name(kind()); }
@@ -70,24 +110,44 @@ public:
   Location  location() const { return loc_; }
   Span      span() const;
 
-  int kind() const { return sym_->kind; }
+  int kind() const;
   
   // Symbol/text representation
-  Symbol const& symbol() const { return *sym_; }
-  String const* str() const    { return &sym_->str; }
+  Symbol_id     symbol_id() const { return sym_; }
+  Symbol const& symbol() const    { return symbols().symbol(sym_); }
+  String_view   str() const       { return symbols().spelling(sym_); }
 
 private:
   Location   loc_;
-  Symbol*    sym_;
+  Symbol_id  sym_;
 };
 
 
+// Initialize a token of an installed kind, whose spelling is
+// that of the kind. This does not search the symbol table.
+inline
+Token::Token(Location loc, int k)
+  : loc_(loc), sym_(get_token_symbol(k))
+{
+  assert(sym_ != no_symbol);
+}
+
+
+// Returns the kind of the token. The kind of an invalid token
+// is unknown_tok.
+inline int
+Token::kind() const
+{
+  return sym_ == no_symbol ? unknown_tok : symbols().kind(sym_);
+}
+
+
 // Returns the span of the token.
 inline Span
 Token::span() const
 {
   Location start = location();
-  Location end(start.offset() + str()->size());
+  Location end(start.offset() + symbols().length(sym_));
   return {start, end};
 }
 
@@ -96,6 +156,380 @@ Token::span() const
 using Token_list = std::vector<Token>;
 
 
+// -------------------------------------------------------------------------- //
+//                              Token buffers
+
+// A token buffer stores a sequence of tokens with their kinds in a
+// separate, parallel array of 16-bit values. Testing the kind of a
+// token in a buffer reads that array, not the symbol table, so a
+// parser that mostly tests kinds streams through 2 bytes per token.
+//
+// The tokens themselves (each an offset and a symbol id) are kept
+// in a second array, so pointers to the tokens in a buffer can be
+// returned by the parsing algorithms. Token kinds must be in the
+// range [0, 65535].
+class Token_buffer
+{
+public:
+  Token_buffer() = default;
+  explicit Token_buffer(Token_list const&);
+
+  void reserve(std::size_t n);
+  void push_back(Token const&);
+
+  bool        empty() const { return toks_.empty(); }
+  std::size_t size() const  { return toks_.size(); }
+
+  Token const& operator[](std::size_t n) const { return toks_[n]; }
+  int          kind(std::size_t n) const       { return kinds_[n]; }
+
+  Token const*         data() const  { return toks_.data(); }
+  std::uint16_t const* kinds() const { return kinds_.data(); }
+
+  Token const* begin() const { return toks_.data(); }
+  Token const* end() const   { return toks_.data() + toks_.size(); }
+
+private:
+  std::vector<std::uint16_t> kinds_;
+  Token_list                 toks_;
+};
+
+
+inline void
+Token_buffer::reserve(std::size_t n)
+{
+  kinds_.reserve(n);
+  toks_.reserve(n);
+}
+
+
+inline void
+Token_buffer::push_back(Token const& tok)
+{
+  int k = tok.kind();
+  lingo_assert(0 <= k && k <= 0xffff);
+  kinds_.push_back(k);
+  toks_.push_back(tok);
+}
+
+
+// -------------------------------------------------------------------------- //
+//                              Token sets
+//
+// A token set recognizes the fixed tokens of a language (e.g., its
+// keywords and punctuators) without using the symbol table. The
+// tokens are described by a specification, giving the same kind,
+// name, and spelling passed to install_token:
+//
+//    constexpr Token_spec spec[] = {
+//      {plus_tok, "plus_tok", "+"},
+//      ...
+//    };
+//
+// A token table is built from the specification at compile time.
+// It contains a perfect hash function of the spellings, found by
+// hash and displace: each spelling is hashed to a bucket, and each
+// bucket has a displacement that maps its spellings to distinct
+// slots. The hash is not minimal; at least half the slots are
+// empty, which makes displacements easy to find. Recognizing a
+// string computes two hashes and compares it with at most one
+// spelling.
+//
+//    constexpr auto table = make_token_table(spec);
+//
+// A token set pairs a table with the installed tokens, so that
+// a recognized spelling can be turned into a token by its kind.
+//
+//    auto tokens = make_token_set(table);
+//    tokens.install();
+//    Token tok = tokens.token(loc, first, last);
+
+
+// The specification of a fixed token.
+struct Token_spec
+{
+  int         kind;
+  char const* name;
+  char const* spelling;
+};
+
+
+namespace token_set_impl
+{
+
+// Returns the length of a C-string.
+constexpr std::size_t
+length(char const* s)
+{
+  std::size_t n = 0;
+  while (s[n])
+    ++n;
+  return n;
+}
+
+
+// Returns true if the characters in [first, last) are the C-string
+// `s`.
+constexpr bool
+equal(char const* s, char const* first, char const* last)
+{
+  for (; first != last; ++first, ++s) {
+    if (*s != *first)
+      return false;
+  }
+  return *s == 0;
+}
+
+
+// Returns the hash of [first, last) for the displacement `d`.
+constexpr std::uint32_t
+hash(std::uint32_t d, char const* first, char const* last)
+{
+  std::uint32_t h = 2166136261u ^ (d * 0x9e3779b9u);
+  for (; first != last; ++first)
+    h = (h ^ (unsigned char)*first) * 16777619u;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  return h;
+}
+
+
+// Returns the least power of 2 not less than `n`.
+constexpr std::size_t
+ceil2(std::size_t n)
+{
+  std::size_t k = 1;
+  while (k < n)
+    k *= 2;
+  return k;
+}
+
+} // namespace token_set_impl
+
+
+// A token table is a perfect hash table of token spellings. The
+// number of slots is the power of 2 at or above twice the number
+// of tokens, and there is about one bucket for every two tokens.
+//
+// Construction fails to compile if two tokens have the same 
+// spelling or if no perfect hash function can be found.
+template<std::size_t N>
+class Token_table
+{
+public:
+  static constexpr std::size_t slots = token_set_impl::ceil2(2 * N);
+  static constexpr std::size_t buckets = token_set_impl::ceil2((N + 1) / 2);
+
+  constexpr explicit Token_table(Token_spec const (&)[N]);
+
+  constexpr std::size_t size() const { return N; }
+
+  constexpr Token_spec const& operator[](std::size_t n) const { return spec_[n]; }
+
+  constexpr int find(char const*, char const*) const;
+  constexpr int find(char const* s) const { return find(s, s + token_set_impl::length(s)); }
+
+private:
+  constexpr std::size_t bucket(char const*, char const*) const;
+  constexpr std::size_t slot(std::uint32_t, char const*, char const*) const;
+
+  Token_spec    spec_[N] {};
+  std::uint32_t disp_[buckets] {};
+  int           slot_[slots] {};
+};
+
+
+template<std::size_t N>
+constexpr std::size_t Token_table<N>::slots;
+
+
+template<std::size_t N>
+constexpr std::size_t Token_table<N>::buckets;
+
+
+// Build the perfect hash function. Buckets are placed in order
+// of decreasing size. For each bucket, the displacements 1, 2, ...
+// are tried until one maps each spelling in the bucket to a free
+// slot.
+template<std::size_t N>
+constexpr
+Token_table<N>::Token_table(Token_spec const (&spec)[N])
+{
+  using namespace token_set_impl;
+  for (std::size_t i = 0; i != N; ++i) {
+    spec_[i] = spec[i];
+    for (std::size_t j = 0; j != i; ++j) {
+      char const* s = spec[i].spelling;
+      if (equal(spec[j].spelling, s, s + length(s)))
+        throw std::logic_error("duplicate token spelling");
+    }
+  }
+  for (std::size_t i = 0; i != slots; ++i)
+    slot_[i] = -1;
+
+  // Count the tokens in each bucket.
+  std::size_t count[buckets] {};
+  for (std::size_t i = 0; i != N; ++i) {
+    char const* s = spec[i].spelling;
+    ++count[bucket(s, s + length(s))];
+  }
+
+  bool done[buckets] {};
+  for (std::size_t k = 0; k != buckets; ++k) {
+    // Select the largest remaining bucket.
+    std::size_t b = buckets;
+    for (std::size_t i = 0; i != buckets; ++i) {
+      if (!done[i] && (b == buckets || count[i] > count[b]))
+        b = i;
+    }
+    done[b] = true;
+    if (count[b] == 0)
+      continue;
+
+    // Find a displacement for the bucket.
+    for (std::uint32_t d = 1; ; ++d) {
+      if (d == 1 << 16)
+        throw std::logic_error("no perfect hash for token set");
+      int taken[N] {};
+      std::size_t n = 0;
+      bool ok = true;
+      for (std::size_t i = 0; ok && i != N; ++i) {
+        char const* s = spec[i].spelling;
+        char const* e = s + length(s);
+        if (bucket(s, e) != b)
+          continue;
+        std::size_t x = slot(d, s, e);
+        if (slot_[x] != -1)
+          ok = false;
+        for (std::size_t j = 0; ok && j != n; ++j) {
+          if (taken[j] == (int)x)
+            ok = false;
+        }
+        taken[n++] = x;
+      }
+      if (ok) {
+        disp_[b] = d;
+        for (std::size_t i = 0, j = 0; i != N; ++i) {
+          char const* s = spec[i].spelling;
+          if (bucket(s, s + length(s)) == b)
+            slot_[taken[j++]] = i;
+        }
+        break;
+      }
+    }
+  }
+}
+
+
+template<std::size_t N>
+constexpr std::size_t
+Token_table<N>::bucket(char const* first, char const* last) const
+{
+  return token_set_impl::hash(0, first, last) & (buckets - 1);
+}
+
+
+template<std::size_t N>
+constexpr std::size_t
+Token_table<N>::slot(std::uint32_t d, char const* first, char const* last) const
+{
+  return token_set_impl::hash(d, first, last) & (slots - 1);
+}
+
+
+// Returns the index of the token spelled by the characters in
+// [first, last), or -1 if there is no such token.
+template<std::size_t N>
+constexpr int
+Token_table<N>::find(char const* first, char const* last) const
+{
+  int n = slot_[slot(disp_[bucket(first, last)], first, last)];
+  if (n >= 0 && token_set_impl::equal(spec_[n].spelling, first, last))
+    return n;
+  return -1;
+}
+
+
+// Returns a token table for the given specification.
+template<std::size_t N>
+constexpr Token_table<N>
+make_token_table(Token_spec const (&spec)[N])
+{
+  return Token_table<N>(spec);
+}
+
+
+// A token set associates a token table with the installed tokens
+// of its specification. The table must outlive the set. Tokens are
+// created by kind (see Token(Location, int)), so the set stores no
+// symbols of its own.
+template<std::size_t N>
+class Token_set
+{
+public:
+  explicit Token_set(Token_table<N> const& t)
+    : table_(&t)
+  { }
+
+  void install();
+
+  Token_table<N> const& table() const { return *table_; }
+
+  int find(char const* first, char const* last) const { return table_->find(first, last); }
+
+  Token token(Location, int) const;
+  Token token(Location, char const*, char const*) const;
+
+private:
+  Token_table<N> const* table_;
+};
+
+
+// Install each token in the set.
+template<std::size_t N>
+void
+Token_set<N>::install()
+{
+  for (std::size_t i = 0; i != N; ++i) {
+    Token_spec const& t = (*table_)[i];
+    install_token(t.kind, t.name, t.spelling);
+  }
+}
+
+
+// Returns the nth token of the set at the given location.
+template<std::size_t N>
+inline Token
+Token_set<N>::token(Location loc, int n) const
+{
+  return Token(loc, (*table_)[n].kind);
+}
+
+
+// Returns the token spelled by [first, last) at the given location.
+// If the characters do not spell a token in the set, the result is
+// an invalid token.
+template<std::size_t N>
+inline Token
+Token_set<N>::token(Location loc, char const* first, char const* last) const
+{
+  int n = find(first, last);
+  if (n < 0)
+    return Token();
+  return token(loc, n);
+}
+
+
+// Returns a token set for the given table.
+template<std::size_t N>
+inline Token_set<N>
+make_token_set(Token_table<N> const& t)
+{
+  return Token_set<N>(t);
+}
+
+
 // -------------------------------------------------------------------------- //
 //                              Printing
 
@@ -114,25 +548,40 @@ std::ostream& operator<<(std::ostream&, Token const&);
 // simple streaming interface consisting of only 5 functions:
 // peek(), get(), and eof(), begin(), and end(). Character streams
 // are the input to lexical analyzers.
-class Token_stream
+//
+// As with character streams, the tracking policy determines how
+// the stream maintains the input location (see Basic_character_stream).
+template<typename Tracking>
+class Basic_token_stream
 {
 public:
   using value_type = Token;
 
   // Construct a token stream over a non-empty range of token pointers.
-  Token_stream(Token const* f, Token const* l)
-    : first_(f), last_(l)
+  Basic_token_stream(Token const* f, Token const* l)
+    : first_(f), last_(l), base_(f), track_(&input_location_of, this)
   { }
 
-  Token_stream(Token_list const& toks)
-    : Token_stream(toks.data(), toks.data() + toks.size())
+  Basic_token_stream(Token_list const& toks)
+    : Basic_token_stream(toks.data(), toks.data() + toks.size())
   { }
 
+  Basic_token_stream(Basic_token_stream const& s)
+    : first_(s.first_), last_(s.last_), base_(s.base_), track_(s.track_, this)
+  { }
+
+  Basic_token_stream(Basic_token_stream&& s)
+    : first_(s.first_), last_(s.last_), base_(s.base_), track_(std::move(s.track_), this)
+  { }
+
+  Basic_token_stream& operator=(Basic_token_stream const&) = default;
+
   // Stream control
   bool eof() const { return first_ == last_; }
   Token const& peek() const;
   Token const& peek(int) const;
   Token const& get();
+  int peek_kind() const { return peek().kind(); }
   Token const& last() { return *(last_ - 1); }
   Token const& last() const { return *(last_ - 1); }
 
@@ -150,9 +599,293 @@ public:
 
   Token const* first_; // Current character pointer
   Token const* last_;  // Past the end of the character buffer
+  Token const* base_;  // The first token
+
+private:
+  static Location input_location_of(void const*);
+
+  Tracking track_;
+};
+
+
+// A token stream that sets the input location for each token read.
+using Eager_token_stream = Basic_token_stream<Eager_tracking>;
+
+
+// A token stream that computes the input location lazily.
+using Token_stream = Basic_token_stream<Lazy_tracking>;
+
+
+template<typename T>
+inline Token const& 
+Basic_token_stream<T>::peek() const
+{
+  assert(!eof());
+  return *first_;
+}
+
+
+template<typename T>
+inline Token const&
+Basic_token_stream<T>::peek(int n) const
+{
+  assert(n <= (last_ - first_));
+  return *(first_ + n);
+}
+
+
+// Returns the current token and advances the stream. With eager
+// tracking, the token's location is saved as the input location.
+template<typename T>
+inline Token const& 
+Basic_token_stream<T>::get()
+{
+  assert(!eof());
+  track_.update(first_->location());
+  return *first_++;
+}
+
+
+// Returns the location of the last token read from the stream
+// `p`, or no location if no tokens have been read.
+template<typename T>
+Location
+Basic_token_stream<T>::input_location_of(void const* p)
+{
+  Basic_token_stream const& s = *static_cast<Basic_token_stream const*>(p);
+  if (s.first_ == s.base_)
+    return Location::none;
+  return (s.first_ - 1)->location();
+}
+
+
+// A token buffer stream is a token stream over a token buffer. The
+// kind of the current token is read from the buffer's array of
+// kinds (see peek_kind). The input location is tracked lazily.
+class Token_buffer_stream
+{
+public:
+  using value_type = Token;
+
+  Token_buffer_stream(Token_buffer const& buf)
+    : first_(buf.begin()), last_(buf.end()), kinds_(buf.kinds())
+    , base_(first_), track_(&input_location_of, this)
+  { }
+
+  Token_buffer_stream(Token_buffer_stream const& s)
+    : first_(s.first_), last_(s.last_), kinds_(s.kinds_)
+    , base_(s.base_), track_(s.track_, this)
+  { }
+
+  Token_buffer_stream(Token_buffer_stream&& s)
+    : first_(s.first_), last_(s.last_), kinds_(s.kinds_)
+    , base_(s.base_), track_(std::move(s.track_), this)
+  { }
+
+  Token_buffer_stream& operator=(Token_buffer_stream const&) = default;
+
+  // Stream control
+  bool eof() const { return first_ == last_; }
+  Token const& peek() const;
+  Token const& peek(int) const;
+  Token const& get();
+  int peek_kind() const;
+  Token const& last() const { return *(last_ - 1); }
+
+  // Iterators
+  Token const* begin() const { return first_; }
+  Token const* end() const { return last_; }
+
+  // Returns the source location of the the current token.
+  Location location() const { return eof() ? Location{} : peek().location(); }
+
+  // Returns the last source location for a token in the buffer.
+  Location last_location() const { return last().span().end(); }
+
+  Token const*         first_; // Current token
+  Token const*         last_;  // Past the end of the tokens
+  std::uint16_t const* kinds_; // The kind of the current token
+  Token const*         base_;  // The first token
+
+private:
+  static Location input_location_of(void const*);
+
+  Lazy_tracking track_;
 };
 
 
+inline Token const&
+Token_buffer_stream::peek() const
+{
+  assert(!eof());
+  return *first_;
+}
+
+
+inline Token const&
+Token_buffer_stream::peek(int n) const
+{
+  assert(n <= (last_ - first_));
+  return *(first_ + n);
+}
+
+
+// Returns the kind of the current token.
+inline int
+Token_buffer_stream::peek_kind() const
+{
+  assert(!eof());
+  return *kinds_;
+}
+
+
+inline Token const&
+Token_buffer_stream::get()
+{
+  assert(!eof());
+  track_.update(first_->location());
+  ++kinds_;
+  return *first_++;
+}
+
+
+// Returns the location of the last token read from the stream
+// `p`, or no location if no tokens have been read.
+inline Location
+Token_buffer_stream::input_location_of(void const* p)
+{
+  Token_buffer_stream const& s = *static_cast<Token_buffer_stream const*>(p);
+  if (s.first_ == s.base_)
+    return Location::none;
+  return (s.first_ - 1)->location();
+}
+
+
+// A token source returns the next token of some input each time
+// it is called, and an invalid token (see Token::operator bool)
+// at the end of the input. This is typically a lambda that calls
+// a language's lexer.
+using Token_source = std::function<Token()>;
+
+
+// A lazy token stream pulls tokens from a token source as they are
+// needed by the parser, rather than lexing the entire input first.
+// This lets parsing begin as soon as the first token is lexed.
+//
+// The tokens obtained from the source are kept in chunks of fixed
+// size that never move, so the token pointers returned by the
+// parsing algorithms remain valid for the lifetime of the stream.
+// Unlike a token list, storage is never reallocated and copied as
+// the input grows.
+//
+// Note that lexical and syntactic diagnostics are interleaved
+// when using a lazy stream. The input location is tracked lazily,
+// and the stream's tracker is suspended while the source is called,
+// so diagnostics emitted by the lexer use the lexer's locations.
+class Lazy_token_stream
+{
+public:
+  using value_type = Token;
+
+  static constexpr int chunk_bits = 10;
+  static constexpr std::size_t chunk_size = std::size_t(1) << chunk_bits;
+
+  explicit Lazy_token_stream(Token_source);
+
+  Lazy_token_stream(Lazy_token_stream const&) = delete;
+  Lazy_token_stream& operator=(Lazy_token_stream const&) = delete;
+
+  // Stream control
+  bool eof() const { return !available(0); }
+  Token const& peek() const;
+  Token const& peek(int) const;
+  Token const& get();
+  int peek_kind() const { return peek().kind(); }
+  Token const& last() const;
+
+  // Returns a pointer to the current token. This is only valid
+  // when the stream is not at the end of input.
+  Token const* begin() const { return &peek(); }
+
+  // Returns the source location of the the current token.
+  Location location() const { return eof() ? Location{} : peek().location(); }
+
+  // Returns the last source location of the most recent token.
+  Location last_location() const { return last().span().end(); }
+
+private:
+  bool  available(std::size_t) const;
+  bool  pull() const;
+  Token const& at(std::size_t n) const { return chunks_[n >> chunk_bits][n & (chunk_size - 1)]; }
+
+  static Location input_location_of(void const*);
+
+  Token_source                                    source_;
+  mutable std::vector<std::unique_ptr<Token[]>>   chunks_;
+  mutable std::size_t                             size_;  // Tokens pulled
+  mutable bool                                    done_;  // True at end of input
+  std::size_t                                     pos_;   // The current token
+  mutable Lazy_tracking                           track_;
+};
+
+
+// Returns true if there are at least n + 1 tokens following the
+// current position, pulling tokens from the source as needed.
+inline bool
+Lazy_token_stream::available(std::size_t n) const
+{
+  while (pos_ + n >= size_) {
+    if (!pull())
+      return false;
+  }
+  return true;
+}
+
+
+// Returns the current token, pulling it from the source if needed.
+// The stream must not be at the end of input.
+inline Token const&
+Lazy_token_stream::peek() const
+{
+  bool ok = available(0);
+  lingo_assert(ok);
+  return at(pos_);
+}
+
+
+// Returns the nth token past the current position, pulling tokens
+// from the source as needed. If the input ends before that token,
+// this returns an invalid token, whose kind is unknown_tok.
+inline Token const&
+Lazy_token_stream::peek(int n) const
+{
+  static Token const none;
+  if (!available(n))
+    return none;
+  return at(pos_ + n);
+}
+
+
+inline Token const&
+Lazy_token_stream::get()
+{
+  Token const& tok = peek();
+  track_.update(tok.location());
+  ++pos_;
+  return tok;
+}
+
+
+// Returns the most recently lexed token. At least one token
+// must have been lexed.
+inline Token const&
+Lazy_token_stream::last() const
+{
+  assert(size_ != 0);
+  return at(size_ - 1);
+}
+
+
 // Debug print a token string.
 inline void 
 debug(Printer& p, Token_stream const& toks)
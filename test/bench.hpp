@@ -0,0 +1,31 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+#ifndef LINGO_TEST_BENCH_HPP
+#define LINGO_TEST_BENCH_HPP
+
+// Facilities shared by the benchmark programs.
+
+#include <random>
+#include <string>
+
+
+// Returns a text of `size` characters made of random lines of
+// 0 to 79 characters.
+inline std::string
+make_text(std::size_t size, std::minstd_rand& gen)
+{
+  std::uniform_int_distribution<int> len(0, 79);
+  std::string text(size, 'x');
+  std::size_t i = 0;
+  while (true) {
+    i += len(gen);
+    if (i >= size)
+      break;
+    text[i++] = '\n';
+  }
+  return text;
+}
+
+
+#endif
@@ -0,0 +1,108 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks the edit buffer against a string to which the
+// same edits are applied. Text is inserted and erased across piece
+// boundaries, and after each edit the line and column of every
+// location, and the offset of every line, are compared with those of
+// a buffer holding the same text. The text contains multibyte UTF-8
+// characters. It also checks that remap() moves locations before,
+// inside, and after an edit.
+
+#include "lingo/edit.hpp"
+
+#include <iostream>
+#include <random>
+
+using namespace lingo;
+
+
+int
+main()
+{
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  // Compare the edit buffer with the expected text.
+  auto compare = [&check](Edit_buffer const& eb, String const& text) {
+    check(eb.str() == text, "text after an edit");
+    check(eb.size() == (int)text.size(), "size after an edit");
+    Buffer buf(text);
+    check(eb.line_count() == buf.lines().size(), "line count after an edit");
+    for (int n = 0; n < eb.line_count() && n < buf.lines().size(); ++n)
+      check(eb.line_offset(n) == buf.lines().line_offset(n), "line offset after an edit");
+    for (int i = 0; i < (int)text.size(); ++i) {
+      check(eb.line_no(Location(i)) == buf.line_no(Location(i)), "line after an edit");
+      check(eb.column_no(Location(i)) == buf.column_no(Location(i)), "column after an edit");
+    }
+  };
+
+  // Edit the text. The snowman (3 bytes) and e-acute (2 bytes) are
+  // multibyte characters.
+  String text = "ab\xc3\xa9\ncd\n\xe2\x98\x83 ef";
+  Edit_buffer eb(text);
+  compare(eb, text);
+
+  eb.insert(3, "x\ny");
+  text.insert(3, "x\ny");
+  compare(eb, text);
+
+  eb.insert(0, "\xc3\xa9\xc3\xa9");
+  text.insert(0, "\xc3\xa9\xc3\xa9");
+  compare(eb, text);
+
+  eb.insert(eb.size(), "\n\xe2\x98\x83");
+  text.append("\n\xe2\x98\x83");
+  compare(eb, text);
+
+  // Erase across the boundaries of the inserted pieces.
+  eb.erase(2, 5);
+  text.erase(2, 5);
+  compare(eb, text);
+
+  eb.replace(1, 8, "z\n");
+  text.replace(1, 8, "z\n");
+  compare(eb, text);
+
+  // Apply random edits.
+  std::minstd_rand gen;
+  char const* pieces[] = {"a", "\n", "\xc3\xa9", "b\nc", "\xe2\x98\x83\n"};
+  for (int i = 0; i != 200; ++i) {
+    int off = std::uniform_int_distribution<int>(0, text.size())(gen);
+    if (i % 3 == 2) {
+      int n = std::uniform_int_distribution<int>(0, text.size() - off)(gen);
+      eb.erase(off, n);
+      text.erase(off, n);
+    } else {
+      char const* s = pieces[i % 5];
+      eb.insert(off, s);
+      text.insert(off, s);
+    }
+  }
+  compare(eb, text);
+
+  // Remap locations around an edit that replaces 3 characters at
+  // offset 10 with 5 characters.
+  Edit e {10, 3, 5};
+  check(remap(Location(4), e) == Location(4), "remap a location before an edit");
+  check(remap(Location(11), e) == Location(10), "remap a location inside an edit");
+  check(remap(Location(13), e) == Location(15), "remap a location after an edit");
+  check(!remap(Location(), e), "remap no location");
+  Span s = remap(Span(Location(8), Location(20)), e);
+  check(s.start() == Location(8) && s.end() == Location(22), "remap a span around an edit");
+
+  // Remap locations around an insertion and an erasure.
+  Edit ins = eb.insert(2, "abc");
+  check(remap(Location(2), ins) == Location(5), "remap a location at an insertion");
+  check(remap(Location(1), ins) == Location(1), "remap a location before an insertion");
+  Edit del = eb.erase(2, 3);
+  check(remap(Location(3), del) == Location(2), "remap a location inside an erasure");
+  check(remap(Location(6), del) == Location(3), "remap a location after an erasure");
+
+  return errs != 0;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks that a file character stream lexes an input
+// much larger than its window. The input has identifiers, comments,
+// and runs of white space, and many of them cross the boundary of
+// the window. Identifiers are marked; comments and white space are
+// skipped without a mark, and some are longer than the window.
+
+#include "lingo/character.hpp"
+#include "lingo/lexing.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace lingo;
+
+
+int
+main()
+{
+  constexpr int window = 64;
+
+  // Build the input, saving each identifier and its offset.
+  std::string text;
+  std::vector<std::string> ids;
+  std::vector<std::int64_t> offs;
+  for (int i = 0; i < 2000; ++i) {
+    // Identifiers have up to window - lookahead characters.
+    std::string id = std::to_string(i);
+    id.insert(0, 1 + i % (window - File_character_stream::lookahead - 4), 'a' + i % 26);
+    ids.push_back(id);
+    offs.push_back(text.size());
+    text += id;
+    text += std::string(1 + i % 97, ' ');
+    if (i % 3 == 0)
+      text += "#" + std::string(i % 300, '-') + "\n";
+  }
+
+  std::FILE* f = std::tmpfile();
+  std::fwrite(text.data(), 1, text.size(), f);
+  std::fflush(f);
+  std::rewind(f);
+
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  File_character_stream cs(fileno(f), window);
+  std::size_t n = 0;
+  while (!cs.eof()) {
+    if (is_space(cs.peek())) {
+      cs.get();
+    } else if (cs.peek() == '#') {
+      while (!cs.eof() && cs.peek() != '\n')
+        cs.get();
+    } else {
+      cs.mark();
+      Wide_location loc = cs.location();
+      char const* first = cs.begin();
+      while (!cs.eof() && is_identifier_rest(cs.peek()))
+        cs.get();
+      std::string id(first, cs.begin());
+      cs.discard();
+      if (n < ids.size()) {
+        check(id == ids[n], "identifier text");
+        check(loc == Wide_location(offs[n]), "identifier location");
+      }
+      ++n;
+    }
+  }
+  check(n == ids.size(), "number of identifiers");
+  check(cs.location() == Wide_location(text.size()), "location at the end of input");
+
+  std::fclose(f);
+  return errs != 0;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks that the file manager opens a file once for
+// different paths, that it evicts the least recently used files that
+// are not pinned when a file is opened, that resolving a location in
+// an evicted file reloads it without evicting other files, and that
+// it counts hits, misses, and evictions.
+
+#include "lingo/file.hpp"
+
+#include <fstream>
+#include <iostream>
+
+using namespace lingo;
+
+namespace fs = boost::filesystem;
+
+
+// Write a file of `n` characters at `p`.
+void
+write_file(Path const& p, std::size_t n)
+{
+  std::ofstream os(p.native(), std::ios::binary);
+  os << std::string(n, 'x');
+}
+
+
+int
+main()
+{
+  constexpr std::size_t size = 100;
+
+  Path dir = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directories(dir / "sub");
+  write_file(dir / "a.txt", size);
+  write_file(dir / "b.txt", size);
+  write_file(dir / "c.txt", size);
+
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  File_manager fm;
+
+  // Different paths to the same file open the same file.
+  File& a = fm.open(dir / "a.txt");
+  File& a2 = fm.open(dir / "sub" / ".." / "a.txt");
+  check(&a == &a2, "different paths open the same file");
+  check(fm.stats().hits == 1 && fm.stats().misses == 1, "stats after reopening a file");
+
+  // Opening a third file evicts the least recently used one. The
+  // limit leaves room for the line maps of two files.
+  File& b = fm.open(dir / "b.txt");
+  fm.set_memory_limit(2 * size + 16);
+  File& c = fm.open(dir / "c.txt");
+  check(!a.is_resident() && b.is_resident() && c.is_resident(), "evict the least recently used file");
+  check(fm.memory() <= fm.memory_limit(), "memory after eviction");
+
+  // Pinned files are not evicted.
+  fm.pin(b);
+  check(&fm.file(a.index()) == &a, "file() returns the file");
+  check(a.is_resident() && b.is_resident() && !c.is_resident(), "do not evict pinned files");
+  fm.unpin(b);
+
+  // Resolving a location in an evicted file does not evict others,
+  // so lines taken from them remain valid.
+  Line line = a.line(Location(0));
+  check(c.line_no(Location(0)) == 1, "resolve a location in an evicted file");
+  check(a.is_resident() && b.is_resident() && c.is_resident(), "resolving a location does not evict");
+  check(line.str().str() == a.str(), "lines remain valid after resolving a location");
+
+  // The next open evicts the unpinned least recently used file.
+  fm.open(dir / "a.txt");
+  check(a.is_resident() && !b.is_resident() && c.is_resident(), "evict an unpinned file");
+
+  File_manager::Stats const& st = fm.stats();
+  check(st.hits == 2, "number of hits");
+  check(st.misses == 5, "number of misses");
+  check(st.evictions == 3, "number of evictions");
+
+  fs::remove_all(dir);
+  return errs != 0;
+}
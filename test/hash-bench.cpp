@@ -0,0 +1,157 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program measures the quality and speed of the string hash
+// function used by the symbol table. The identifiers in the files
+// named on the command line are used as the corpus. Example:
+//
+//    hash-bench lingo/*.cpp lingo/*.hpp /usr/include/c++/*/*
+//
+// For each hash function, the program reports the number of full
+// hash collisions, the number of identifiers sharing a bucket in a
+// power-of-2 table using the low bits of the hash (and the number
+// expected of a random function), and the time taken to hash the
+// corpus. The same is reported for a set of long generated names
+// that differ only in their final characters.
+
+#include "lingo/string.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <unordered_set>
+#include <vector>
+
+using namespace lingo;
+
+using Iter = std::istreambuf_iterator<char>;
+using Clock = std::chrono::steady_clock;
+
+
+// The hash function used by the symbol table before hash_bytes.
+std::uint64_t
+legacy_hash(char const* first, char const* last)
+{
+  std::size_t h = 0;
+  while (first != last)
+    h = h << 1 ^ *first++;
+  return h;
+}
+
+
+std::uint64_t
+std_hash(char const* first, char const* last)
+{
+  return std::hash<std::string>()(std::string(first, last));
+}
+
+
+using Hash_fn = std::uint64_t (*)(char const*, char const*);
+
+
+// Add the identifiers in `text` to `ids`.
+void
+add_identifiers(std::string const& text, std::unordered_set<std::string>& ids)
+{
+  auto is_first = [](char c) { return std::isalpha(c) || c == '_'; };
+  auto is_rest = [](char c) { return std::isalnum(c) || c == '_'; };
+  std::size_t i = 0;
+  while (i != text.size()) {
+    if (is_first(text[i])) {
+      std::size_t j = i + 1;
+      while (j != text.size() && is_rest(text[j]))
+        ++j;
+      ids.insert(text.substr(i, j - i));
+      i = j;
+    } else {
+      ++i;
+    }
+  }
+}
+
+
+// Report the quality and speed of `hash` over the strings in `ids`.
+void
+measure(char const* name, Hash_fn hash, std::vector<std::string> const& ids)
+{
+  std::size_t n = ids.size();
+  int bits = 0;
+  while ((std::size_t(1) << bits) < n)
+    ++bits;
+  std::size_t m = std::size_t(1) << bits;
+
+  // Count collisions in the full hash and in the low bits.
+  std::unordered_set<std::uint64_t> full;
+  std::vector<char> buckets(m);
+  std::size_t shared = 0;
+  for (std::string const& s : ids) {
+    std::uint64_t h = hash(s.data(), s.data() + s.size());
+    full.insert(h);
+    if (buckets[h & (m - 1)]++)
+      ++shared;
+  }
+  double expect = n - m * (1 - std::pow(1 - 1.0 / m, n));
+
+  // Time the hash function over several passes of the corpus.
+  std::size_t bytes = 0;
+  for (std::string const& s : ids)
+    bytes += s.size();
+  int passes = std::max<std::size_t>(1, (1 << 26) / (bytes + 1));
+  std::uint64_t sink = 0;
+  auto start = Clock::now();
+  for (int i = 0; i != passes; ++i)
+    for (std::string const& s : ids)
+      sink += hash(s.data(), s.data() + s.size());
+  std::chrono::duration<double> t = Clock::now() - start;
+
+  std::cout << "  " << name << ":\n"
+            << "    full collisions:   " << n - full.size() << '\n'
+            << "    bucket collisions: " << shared << " (random " << std::llround(expect) << ")\n"
+            << "    time:              " << t.count() * 1e9 / (passes * n) << " ns/string, "
+            << bytes * passes / t.count() / 1e9 << " GB/s"
+            << (sink == 42 ? " " : "") << '\n';
+}
+
+
+void
+measure_all(char const* title, std::vector<std::string> const& ids)
+{
+  std::cout << title << " (" << ids.size() << " strings)\n";
+  measure("legacy", legacy_hash, ids);
+  measure("std::hash", std_hash, ids);
+  measure("hash_bytes", hash_bytes, ids);
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "usage: hash-bench <file>...\n";
+    return -1;
+  }
+
+  std::unordered_set<std::string> set;
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream f(argv[i]);
+    add_identifiers(std::string(Iter(f), Iter()), set);
+  }
+  std::vector<std::string> ids(set.begin(), set.end());
+  measure_all("identifiers", ids);
+
+  // Long generated names that differ only in their suffix.
+  std::vector<std::string> names;
+  std::string prefix = "generated_name_for_a_template_instantiation_of_some_long_type_";
+  for (int i = 0; i != 100000; ++i)
+    names.push_back(prefix + std::to_string(i));
+  measure_all("generated names", names);
+
+  // Long strings.
+  std::vector<std::string> texts;
+  for (int i = 0; i != 1000; ++i)
+    texts.push_back(std::string(4096, 'x') + std::to_string(i));
+  measure_all("4K strings", texts);
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program measures how parallel line indexing scales with the
+// number of threads. The arguments are the largest number of threads
+// and the size of the generated input, in megabytes. Example:
+//
+//    index-bench 8 500
+//
+// The input consists of random lines of 0 to 79 characters. For
+// each number of threads from 1 to the given number, the program
+// reports the best of several times taken to build the line map,
+// the speedup over a single thread, and whether the map matches the
+// one built sequentially. Note that the global thread pool is sized
+// to the hardware, so scaling stops at the number of cores.
+
+#include "lingo/buffer.hpp"
+#include "lingo/thread.hpp"
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace lingo;
+
+using Clock = std::chrono::steady_clock;
+
+
+// The number of times each line map is built.
+constexpr int passes = 5;
+
+
+bool
+operator==(Line_map const& a, Line_map const& b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (int i = 0; i != a.size(); ++i)
+    if (a.line_offset(i) != b.line_offset(i))
+      return false;
+  return true;
+}
+
+
+// Returns the best time taken to build the line map for `text`.
+double
+measure(std::string const& text)
+{
+  double best = 0;
+  for (int i = 0; i != passes; ++i) {
+    auto start = Clock::now();
+    Line_map map(text.data(), text.data() + text.size());
+    std::chrono::duration<double> t = Clock::now() - start;
+    if (i == 0 || t.count() < best)
+      best = t.count();
+  }
+  return best;
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    std::cerr << "usage: index-bench <threads> <megabytes>\n";
+    return -1;
+  }
+  int threads = std::atoi(argv[1]);
+  std::size_t size = std::strtoul(argv[2], nullptr, 10) << 20;
+  if (threads < 1 || size == 0 || size > 1u << 30) {
+    std::cerr << "error: threads must be positive, and the size must be "
+                 "between 1 and 1024 megabytes\n";
+    return -1;
+  }
+
+  std::minstd_rand gen;
+  std::string text = make_text(size, gen);
+  Line_map seq(text.data(), text.data() + text.size());
+
+  // Start the pool before timing.
+  thread_pool();
+  std::cout << argv[2] << " MB, " << seq.size() << " lines, "
+            << std::thread::hardware_concurrency() << " cores\n";
+
+  double base = 0;
+  for (int n = 1; n <= threads; ++n) {
+    set_parallel_indexing(1, n);
+    double t = measure(text);
+    if (n == 1)
+      base = t;
+    Line_map par(text.data(), text.data() + text.size());
+    std::cout << "  " << n << " threads: " << t << " s, "
+              << base / t << "x" << (par == seq ? "" : " (mismatch)") << '\n';
+  }
+  disable_parallel_indexing();
+}
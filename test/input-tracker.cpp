@@ -0,0 +1,141 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks that the input location is tracked lazily by
+// streams that are destroyed out of order, moved, copied, and
+// assigned. The input location is that of the stream that read most
+// recently or, if that stream has been destroyed, of the most recently
+// registered stream that remains. It also checks that a lazy token
+// stream restores its tracker when its source throws, and that it
+// keeps a location set explicitly by its source.
+
+#include "lingo/character.hpp"
+#include "lingo/token.hpp"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace lingo;
+
+
+// Returns a stream that has read `n` characters.
+Character_stream
+make_stream(Buffer& buf, int n)
+{
+  Character_stream cs(buf);
+  while (n--)
+    cs.get();
+  return cs;
+}
+
+
+int
+main()
+{
+  Buffer buf("abcdefgh");
+  Input_context cxt(buf);
+
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  // Destroy the first stream before the second.
+  {
+    std::unique_ptr<Character_stream> a(new Character_stream(buf));
+    a->get();
+    a->get();
+    std::unique_ptr<Character_stream> b(new Character_stream(buf));
+    b->get();
+    check(input_location() == Location(0), "input location of the last stream");
+    a.reset();
+    check(input_location() == Location(0), "input location after destroying an earlier stream");
+    b.reset();
+    check(input_location() == Location::none, "input location after destroying all streams");
+  }
+
+  // Destroy the second stream before the first.
+  {
+    std::unique_ptr<Character_stream> a(new Character_stream(buf));
+    a->get();
+    a->get();
+    std::unique_ptr<Character_stream> b(new Character_stream(buf));
+    b->get();
+    b.reset();
+    check(input_location() == Location(1), "input location after destroying the last stream");
+  }
+  check(input_location() == Location::none, "input location after the streams go out of scope");
+
+  // Move a stream out of a function, and then into another.
+  {
+    Character_stream a = make_stream(buf, 3);
+    check(input_location() == Location(2), "input location of a returned stream");
+    Character_stream b(std::move(a));
+    b.get();
+    check(input_location() == Location(3), "input location of a moved-to stream");
+  }
+  check(input_location() == Location::none, "input location after moved streams go out of scope");
+
+  install_token(1, "a_tok", "a");
+
+  // Copy and assign token streams, and store them in a vector.
+  {
+    Token_list toks;
+    for (int i = 0; i < 4; ++i)
+      toks.push_back(Token(Location(i), 1));
+    Token_stream a(toks);
+    a.get();
+    Token_stream backup(a);
+    a.get();
+    check(input_location() == Location(1), "input location with a backup copy of the stream");
+    Token_stream b(a);
+    b.get();
+    check(input_location() == Location(2), "input location of a copied stream");
+    a = backup;
+    a.get();
+    check(input_location() == Location(1), "input location after backtracking");
+    std::vector<Token_stream> v;
+    v.push_back(a);
+    v.push_back(b);
+    v.back().get();
+    v.reserve(100);
+    check(input_location() == Location(3), "input location of a stored stream");
+    v.clear();
+    check(input_location() == Location(2), "input location after destroying the active stream");
+  }
+
+  // A lazy token stream whose source reads characters.
+  {
+    Character_stream cs(buf);
+    int n = 0;
+    Lazy_token_stream ts([&]() {
+      if (n == 4)
+        return Token();
+      Location loc = cs.location();
+      check(input_location() == (loc.offset() ? Location(loc.offset() - 1) : Location::none),
+            "input location in the source");
+      if (n == 2)
+        throw n++;
+      cs.get();
+      if (n == 3)
+        set_input_location(Location(42));
+      return Token(Location(10 + n++), 1);
+    });
+    ts.get();
+    ts.peek();
+    check(input_location() == Location(10), "input location after pulling a token");
+    ts.get();
+    try {
+      ts.peek();
+    } catch (int) { }
+    check(input_location() == Location(11), "input location after the source throws");
+    ts.peek();
+    check(input_location() == Location(42), "explicit input location set by the source");
+  }
+
+  return errs != 0;
+}
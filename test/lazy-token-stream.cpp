@@ -0,0 +1,53 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks that a lazy token stream pulls tokens when
+// they are first requested by peek(), peek(n), or get(), without a
+// preceding call to eof(), and that the token returned past the end
+// of input can be inspected. It is built with NDEBUG so that the
+// checks do not depend on assertions.
+
+#include "lingo/token.hpp"
+
+#include <iostream>
+
+using namespace lingo;
+
+
+int
+main()
+{
+  install_token(1, "a_tok", "a");
+  install_token(2, "b_tok", "b");
+
+  // The source produces a b a b a.
+  int n = 0;
+  Lazy_token_stream ts([&n]() {
+    if (n == 5)
+      return Token();
+    Token tok(Location(n), 1 + n % 2);
+    ++n;
+    return tok;
+  });
+
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  check(ts.peek(1).kind() == 2, "peek(1) on a new stream");
+  check(ts.get().kind() == 1, "get() without eof()");
+  check(ts.peek(3).kind() == 1, "peek(3)");
+  check(!ts.peek(4), "peek(n) past the end of input");
+  check(ts.peek(4).kind() == unknown_tok, "kind of peek(n) past the end of input");
+  check(ts.get().location() == Location(1), "get() after peek(n)");
+  check(ts.peek().kind() == 1, "peek()");
+  ts.get();
+  ts.get();
+  ts.get();
+  check(ts.eof(), "eof() after the last token");
+  return errs != 0;
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program compares the line table used by line maps with the
+// std::map of line offsets that it replaced. The arguments are the
+// sizes of the generated inputs, in megabytes. Example:
+//
+//    line-bench 1 100 1024
+//
+// Each input consists of random lines of 0 to 79 characters. For
+// each input and each line map, the program reports the time taken
+// to build the map, and the average time taken to find the line
+// containing a random offset.
+
+#include "lingo/buffer.hpp"
+
+#include "bench.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace lingo;
+
+using Clock = std::chrono::steady_clock;
+
+
+// The number of random lookups for each input.
+constexpr int lookups = 1000000;
+
+
+// The line map replaced by Line_map, mapping the offset of each
+// line to its index.
+struct Tree_line_map
+{
+  Tree_line_map(char const*, char const*);
+
+  int line_index(int) const;
+
+  std::map<int, int> lines;
+};
+
+
+// Build the map one character at a time, as the old lexer did.
+Tree_line_map::Tree_line_map(char const* first, char const* last)
+{
+  int n = 0;
+  lines.insert({0, n++});
+  for (char const* iter = first; iter != last; ++iter) {
+    if (*iter == '\n')
+      lines.insert({int(iter - first + 1), n++});
+  }
+}
+
+
+int
+Tree_line_map::line_index(int off) const
+{
+  return std::prev(lines.upper_bound(off))->second;
+}
+
+
+// Report the build and lookup times for the line map `Map`
+// over `text`, looking up the line of each offset in `offs`.
+template<typename Map, typename Find>
+void
+measure(char const* name, std::string const& text, std::vector<int> const& offs, Find find)
+{
+  auto start = Clock::now();
+  Map map(text.data(), text.data() + text.size());
+  std::chrono::duration<double> build = Clock::now() - start;
+
+  long sink = 0;
+  start = Clock::now();
+  for (int off : offs)
+    sink += find(map, off);
+  std::chrono::duration<double> lookup = Clock::now() - start;
+
+  std::cout << "  " << name << ":\n"
+            << "    build:  " << build.count() << " s\n"
+            << "    lookup: " << lookup.count() * 1e9 / offs.size() << " ns"
+            << (sink == 42 ? " " : "") << '\n';
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "usage: line-bench <megabytes>...\n";
+    return -1;
+  }
+
+  std::minstd_rand gen;
+  for (int i = 1; i < argc; ++i) {
+    std::size_t size = std::strtoul(argv[i], nullptr, 10) << 20;
+    if (size == 0 || size > 1u << 30) {
+      std::cerr << "error: sizes must be between 1 and 1024 megabytes\n";
+      return -1;
+    }
+    std::string text = make_text(size, gen);
+
+    std::uniform_int_distribution<int> dist(0, size - 1);
+    std::vector<int> offs(lookups);
+    for (int& off : offs)
+      off = dist(gen);
+
+    std::cout << argv[i] << " MB\n";
+    measure<Tree_line_map>("std::map", text, offs, [](Tree_line_map const& m, int off) {
+      return m.line_index(off);
+    });
+    measure<Line_map>("Line_map", text, offs, [](Line_map const& m, int off) {
+      return m.line_index(Location(off));
+    });
+  }
+}
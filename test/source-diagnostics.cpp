@@ -0,0 +1,69 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks that diagnostics at source locations are
+// resolved in the buffer that contains them. Two buffers are added
+// to a source manager, and a lexing error is diagnosed in the
+// second, both at the input location and at an explicit location.
+
+#include "lingo/source.hpp"
+#include "lingo/character.hpp"
+
+#include <iostream>
+#include <sstream>
+
+using namespace lingo;
+
+
+// Returns the diagnostics written to std::cerr by `f`.
+template<typename F>
+std::string
+capture(F f)
+{
+  std::stringstream ss;
+  std::streambuf* buf = std::cerr.rdbuf(ss.rdbuf());
+  f();
+  std::cerr.rdbuf(buf);
+  return ss.str();
+}
+
+
+int
+main()
+{
+  Buffer first("abc\ndef\nghi\njkl\n");
+  Buffer second("x\n\xc3\xa9 ? y\n");
+
+  Source_manager sm;
+  sm.add(first);
+  Location base = sm.add(second);
+
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  Input_context cxt(second, sm);
+  Character_stream cs(second, base);
+  while (cs.peek() != '?')
+    cs.get();
+  Location loc = cs.location();
+
+  std::string out = capture([&cs]() {
+    error("unrecognized character '{}'", cs.get());
+  });
+  check(out.find("2:3") != std::string::npos, "line and column at the input location");
+  check(out.find("\xc3\xa9 ? y") != std::string::npos, "source line at the input location");
+
+  out = capture([loc]() {
+    error(loc, "unrecognized character");
+  });
+  check(out.find("2:3") != std::string::npos, "line and column at a source location");
+
+  if (errs)
+    std::cerr << out;
+  return errs != 0;
+}
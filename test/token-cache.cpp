@@ -0,0 +1,111 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks that the token cache of the file manager
+// returns the tokens lexed in an earlier run, at locations relative
+// to the start location given when they are requested, and that an
+// entry is not used when the file is rewritten with the same size
+// and modification time.
+
+#include "lingo/file.hpp"
+
+#include <fstream>
+#include <iostream>
+
+using namespace lingo;
+
+namespace fs = boost::filesystem;
+
+
+// The kind of words. It need not be installed.
+constexpr int word_tok = 1;
+
+
+// Write `text` to the file at `p`.
+void
+write_file(Path const& p, char const* text)
+{
+  std::ofstream os(p.native(), std::ios::binary);
+  os << text;
+}
+
+
+int
+main()
+{
+  Path dir = fs::temp_directory_path() / fs::unique_path();
+  Path path = dir / "input.txt";
+  fs::create_directories(dir);
+  write_file(path, "foo bar foo\nbaz");
+
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  // Lex the words of a file, counting the calls.
+  int lexed = 0;
+  Location start;
+  auto lex = [&lexed, &start](File& file, Token_list& toks) {
+    ++lexed;
+    char const* first = file.begin();
+    for (char const* p = first; p != file.end(); ) {
+      if (*p == ' ' || *p == '\n') {
+        ++p;
+        continue;
+      }
+      char const* q = p;
+      while (q != file.end() && *q != ' ' && *q != '\n')
+        ++q;
+      toks.push_back(Token(Location(start.offset() + (p - first)), word_tok, p, q));
+      p = q;
+    }
+  };
+
+  // A cold run lexes the file.
+  Token_list cold;
+  {
+    File_manager fm;
+    fm.set_token_cache(dir / "cache");
+    start = Location(1000);
+    fm.tokens(fm.open(path), cold, lex, start);
+  }
+  check(lexed == 1, "cold run lexes the file");
+  check(cold.size() == 4, "number of tokens");
+
+  // A warm run does not, even with a different start location.
+  Token_list warm;
+  {
+    File_manager fm;
+    fm.set_token_cache(dir / "cache");
+    start = Location(10);
+    fm.tokens(fm.open(path), warm, lex, start);
+  }
+  check(lexed == 1, "warm run uses the cache");
+  check(warm.size() == cold.size(), "number of cached tokens");
+  for (std::size_t i = 0; i != warm.size() && i != cold.size(); ++i) {
+    check(warm[i].kind() == cold[i].kind(), "kind of a cached token");
+    check(warm[i].str() == cold[i].str(), "spelling of a cached token");
+    check(warm[i].location().offset() + 990 == cold[i].location().offset(), "location of a cached token");
+  }
+
+  // Rewrite the file with the same size and modification time.
+  std::time_t t = fs::last_write_time(path);
+  write_file(path, "foo bar fox\nbaz");
+  fs::last_write_time(path, t);
+  Token_list changed;
+  {
+    File_manager fm;
+    fm.set_token_cache(dir / "cache");
+    start = Location(0);
+    fm.tokens(fm.open(path), changed, lex, start);
+  }
+  check(lexed == 2, "changed file is lexed");
+  check(changed.size() == 4 && changed[2].str().str() == "fox", "tokens of the changed file");
+
+  fs::remove_all(dir);
+  return errs != 0;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2015 Andrew Sutton
+// All rights reserved
+
+// This program checks that a token set recognizes the spellings of
+// its tokens, both at compile time and at run time, and that it
+// creates tokens with the installed kind and spelling.
+
+#include "lingo/token.hpp"
+
+#include <cstring>
+#include <iostream>
+
+using namespace lingo;
+
+
+namespace
+{
+
+constexpr Token_spec spec_[] = {
+  {1, "lparen_tok", "("},
+  {2, "rparen_tok", ")"},
+  {3, "arrow_tok",  "->"},
+  {4, "minus_tok",  "-"},
+  {5, "if_tok",     "if"},
+  {6, "else_tok",   "else"},
+};
+
+constexpr auto table_ = make_token_table(spec_);
+
+static_assert(table_.find("->") == 2, "");
+static_assert(table_.find("else") == 5, "");
+static_assert(table_.find("els") == -1, "");
+
+} // namespace
+
+
+int
+main()
+{
+  auto tokens = make_token_set(table_);
+  tokens.install();
+
+  int errs = 0;
+  auto check = [&errs](bool b, char const* what) {
+    if (!b) {
+      std::cerr << "failed: " << what << '\n';
+      ++errs;
+    }
+  };
+
+  for (std::size_t i = 0; i != table_.size(); ++i) {
+    char const* s = spec_[i].spelling;
+    char const* e = s + std::strlen(s);
+    check(tokens.find(s, e) == (int)i, "find() of each spelling");
+    Token tok = tokens.token(Location(i), s, e);
+    check(tok.kind() == spec_[i].kind, "token() kind");
+    check(tok.str().str() == s, "token() spelling");
+    check(tok.location() == Location(i), "token() location");
+  }
+
+  char const* s = "->x";
+  check(tokens.find(s, s + 1) == 3, "find() of a prefix");
+  check(!tokens.token(Location(), s, s + 3), "token() of an unknown spelling");
+  check(!tokens.token(Location(), s, s), "token() of an empty string");
+  return errs != 0;
+}